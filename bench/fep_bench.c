@@ -0,0 +1,693 @@
+/*
+ * Throughput, latency and CPU benchmark of avr-fep on the host build.
+ *
+ * usage: fep_bench [packets per case]
+ *
+ * Every result is printed as one JSON object per line, so that results of
+ * two releases can be compared with diff or jq.
+ *
+ *  "e2e-tx"  FEP_puts/FEP_putbin to a simulated modem, sweeping payload size,
+ *            string/binary mode, injected N1/N3 rate and number of nodes
+ *            (the other nodes keep the air busy with their own packets).
+ *            Latency is measured on the virtual time of the simulator from
+ *            the call until the final response.
+ *  "batch"   small messages sent one per packet by FEP_putbin, or packed
+ *            by FEP_batchPut (flushed when the packet is full).
+ *  "pipe"    log lines written with 4 fprintf()s each, sent one packet per
+ *            fprintf() ("write"), or one per line through FEP_pipeOpen()
+ *            ("pipe").
+ *  "e2e-rx"  packets sent by a simulated peer and read by FEP_gets. The
+ *            cycles of FEP_rxHandler are measured per received byte.
+ *  "cpu-tx"  host CPU cycles of FEP_putbin/FEP_puts when FEP answers P0
+ *            immediately (no simulator), i.e. the cost of the driver itself.
+ *  "cpu-rx"  host CPU cycles of FEP_rxHandler per byte and FEP_gets per call.
+ *  "prio"    latency of short urgent packets (fep_putsAsyncPrio()) while
+ *            the queue of normal priority is kept full of 250 bytes
+ *            telemetry packets, against queueing them behind the telemetry
+ *            ("fifo"). With max_age_ms, stale telemetry is dropped.
+ *  "tdma"    every node but one sends 64 bytes packets back to back to the
+ *            other one with fep_putbinAsync(), with carrier sense only
+ *            ("csma") or in time slots given by the receiver's beacons
+ *            (fep_tdmaStart(), "tdma"). Aggregate throughput, N1 per try
+ *            and the slowest sender.
+ *  "sleep"   time the AVR runs and sleeps while sending with FEP_putbin
+ *            (FEP_IDLE_SLEEP), and the average current of the MCU against
+ *            busy waiting, where it runs all the time.
+ *
+ * Cycles are of the host CPU (TSC on x86, ns elsewhere), not of the AVR.
+ * Compare them between builds on the same machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+#include "fep.h"
+#include "fep_host.h"
+#include "fep_sim.h"
+
+#define BENCH_MY_ADDR 1
+#define BENCH_PEER_ADDR 2
+#define BENCH_MAX_PACKETS 10000
+
+/*
+ * types
+ */
+/* background node sending packets back to back */
+typedef struct {
+    const fep_transport_t *transport;
+    char cmd[FEP_MAX_DATA_LEN + 16];
+    uint16_t cmdLen;
+    uint8_t head[2];    /* beginning of the line from the modem */
+    uint8_t last;
+    uint16_t lineLen;
+    uint32_t remain;    /* packets to send */
+} bench_node_t;
+
+/* transport between the driver and the simulator which measures rx handler */
+typedef struct {
+    const fep_transport_t *inner;
+    fep_transport_t transport;
+    fep_rxhandler_t handler;
+    void *arg;
+    uint64_t cycles;
+    uint64_t bytes;
+} bench_probe_t;
+
+/*
+ * variables
+ */
+static bench_node_t bench_node[FEP_SIM_MAX_NODES];
+static bench_probe_t bench_probe;
+static uint32_t bench_latency[BENCH_MAX_PACKETS];
+static uint32_t bench_packets = 200;
+static uint64_t bench_overhead;     /* cycles of a pair of bench_cycles() */
+
+/*
+ * functions
+ */
+static uint64_t bench_cycles(void) {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void bench_calibrate(void) {
+    uint64_t start, min = (uint64_t)-1;
+    uint16_t i;
+
+    for (i = 0; i < 1000; i++) {
+        start = bench_cycles();
+        start = bench_cycles() - start;
+        if (start < min) min = start;
+    }
+    bench_overhead = min;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(uint32_t *v, uint32_t n, uint32_t p) {
+    if (n == 0) return 0;
+    return v[(uint32_t)(((uint64_t)n - 1) * p / 100)];
+}
+
+static void bench_fill(char *buf, uint16_t len, uint8_t binary) {
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        /* binary payload contains CR and LF */
+        buf[i] = binary ? (char)(i * 7) : (char)('a' + i % 26);
+    }
+    buf[len] = '\0';
+}
+
+/* background node: send the next packet when the previous one finished */
+static void bench_nodeSend(bench_node_t *node) {
+    if (node->remain == 0) return;
+    node->remain--;
+    (*node->transport->write)(node->transport->ctx, (const uint8_t *)node->cmd, node->cmdLen);
+}
+
+static void bench_nodeRx(void *arg, uint8_t data, uint8_t error) {
+    bench_node_t *node = arg;
+
+    if (node->lineLen < 2) node->head[node->lineLen] = data;
+    node->lineLen++;
+    if (node->last == '\r' && data == '\n') {
+        /* "P0\r\n", "N1\r\n", ... finish the packet. "P1\r\n" doesn't */
+        if (node->lineLen == 4 && !(node->head[0] == 'P' && node->head[1] == '1')) {
+            bench_nodeSend(node);
+        }
+        node->lineLen = 0;
+    }
+    node->last = data;
+}
+
+static void bench_nodeInit(bench_node_t *node, uint8_t sim, uint8_t dest, uint16_t len, uint32_t count) {
+    node->transport = FEP_simTransport(sim);
+    node->cmdLen = snprintf(node->cmd, sizeof(node->cmd), "@TBN%03d%03d", dest, len);
+    memset(node->cmd + node->cmdLen, 0x55, len);
+    node->cmdLen += len;
+    node->cmd[node->cmdLen++] = '\r';
+    node->cmd[node->cmdLen++] = '\n';
+    node->last = 0;
+    node->lineLen = 0;
+    node->remain = count;
+    (*node->transport->setRxHandler)(node->transport->ctx, bench_nodeRx, node);
+}
+
+/* probe transport */
+static void bench_probeRx(void *arg, uint8_t data, uint8_t error) {
+    uint64_t start = bench_cycles();
+
+    (*bench_probe.handler)(bench_probe.arg, data, error);
+    bench_probe.cycles += bench_cycles() - start - bench_overhead;
+    bench_probe.bytes++;
+}
+
+static void bench_probeInit(void *ctx, uint32_t baud) {
+    (*bench_probe.inner->init)(bench_probe.inner->ctx, baud);
+}
+
+static void bench_probeSetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) {
+    bench_probe.handler = handler;
+    bench_probe.arg = arg;
+    (*bench_probe.inner->setRxHandler)(bench_probe.inner->ctx, bench_probeRx, NULL);
+}
+
+static void bench_probeWrite(void *ctx, const uint8_t *buf, uint16_t len) {
+    (*bench_probe.inner->write)(bench_probe.inner->ctx, buf, len);
+}
+
+static const fep_transport_t *bench_probeOpen(const fep_transport_t *inner) {
+    memset(&bench_probe, 0, sizeof(bench_probe));
+    bench_probe.inner = inner;
+    bench_probe.transport.init = bench_probeInit;
+    bench_probe.transport.setRxHandler = bench_probeSetRxHandler;
+    bench_probe.transport.write = bench_probeWrite;
+    return &bench_probe.transport;
+}
+
+/* start the simulator: node 0 is the driver, node 1 the peer, others background */
+static void bench_simStart(uint8_t nodes, uint16_t n1, uint16_t n3) {
+    fep_sim_config_t config;
+    uint8_t i;
+
+    FEP_simDefaultConfig(&config);
+    config.lossPermille = n1;
+    config.fullPermille = n3;
+    FEP_simInit(&config);
+    for (i = 0; i < nodes; i++) {
+        FEP_simAddNode(BENCH_MY_ADDR + i);
+    }
+    FEP_initTransport(bench_probeOpen(FEP_simTransport(0)),
+                      BENCH_MY_ADDR, 1, 2, 3, 0);
+}
+
+static void bench_e2eTx(uint8_t binary, uint16_t size, uint8_t nodes, uint16_t n1, uint16_t n3) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    fep_sim_stats_t stats;
+    uint64_t start, t;
+    uint32_t i, commands, failures = 0;
+    uint8_t j, response;
+
+    bench_simStart(nodes, n1, n3);
+    /* the ping and the reads of the settings by FEP_initTransport() aren't retries */
+    FEP_simGetStats(0, &stats);
+    commands = stats.commands;
+    for (j = 2; j < nodes; j++) {
+        /* background traffic among the other nodes */
+        bench_nodeInit(&bench_node[j], j, BENCH_MY_ADDR + (j % (nodes - 1)) + 1, size, 0xFFFFFFFF);
+        bench_nodeSend(&bench_node[j]);
+    }
+    bench_fill(buf, size, binary);
+
+    start = FEP_simNowUs();
+    for (i = 0; i < bench_packets; i++) {
+        t = FEP_simNowUs();
+        response = binary ? FEP_putbin(buf, size, BENCH_PEER_ADDR) : FEP_puts(buf, BENCH_PEER_ADDR);
+        bench_latency[i] = FEP_simNowUs() - t;
+        if (response != FEP_P0) failures++;
+    }
+    t = FEP_simNowUs() - start;
+
+    FEP_simGetStats(0, &stats);
+    qsort(bench_latency, bench_packets, sizeof(bench_latency[0]), bench_compare);
+    printf("{\"bench\":\"e2e-tx\",\"mode\":\"%s\",\"size\":%u,\"nodes\":%u,"
+           "\"n1_permille\":%u,\"n3_permille\":%u,\"packets\":%u,"
+           "\"throughput_pps\":%.2f,\"throughput_Bps\":%.1f,"
+           "\"lat_p50_us\":%u,\"lat_p99_us\":%u,\"lat_max_us\":%u,"
+           "\"retries\":%u,\"failures\":%u,\"collisions\":%u}\n",
+           binary ? "bin" : "str", size, nodes, n1, n3, bench_packets,
+           (bench_packets - failures) * 1e6 / t, (bench_packets - failures) * (double)size * 1e6 / t,
+           bench_percentile(bench_latency, bench_packets, 50),
+           bench_percentile(bench_latency, bench_packets, 99),
+           bench_latency[bench_packets - 1],
+           stats.commands - commands - bench_packets, failures, stats.collisions);
+}
+
+static void bench_batch(uint8_t batching, uint16_t size) {
+    static fep_batch_t batch;
+    char buf[FEP_MAX_DATA_LEN + 1];
+    fep_sim_stats_t stats;
+    uint64_t start, t;
+    uint32_t i, failures = 0;
+    uint8_t response;
+
+    bench_simStart(2, 0, 0);
+    bench_fill(buf, size, 1);
+    fep_batchInit(&batch, 1000);
+
+    start = FEP_simNowUs();
+    for (i = 0; i < bench_packets; i++) {
+        if (batching) {
+            response = FEP_batchPut(&batch, buf, size, BENCH_PEER_ADDR);
+            if (response == FEP_P1) continue;
+        } else {
+            response = FEP_putbin(buf, size, BENCH_PEER_ADDR);
+        }
+        if (response != FEP_P0) failures++;
+    }
+    if (batching && FEP_batchFlush(&batch) != FEP_P0) failures++;
+    t = FEP_simNowUs() - start;
+
+    FEP_simGetStats(0, &stats);
+    printf("{\"bench\":\"batch\",\"batching\":%u,\"size\":%u,\"messages\":%u,"
+           "\"throughput_mps\":%.2f,\"packets_on_air\":%u,\"failures\":%u}\n",
+           batching, size, bench_packets, bench_packets * 1e6 / t,
+           stats.sent, failures);
+}
+
+static void bench_pipe(uint8_t piping) {
+    static fep_pipe_t pipe;
+    char buf[32];
+    fep_sim_stats_t stats;
+    uint64_t start, t;
+    uint32_t i, failures = 0;
+    uint8_t j;
+    int n;
+
+    bench_simStart(2, 0, 0);
+    FEP_pipeOpen(&pipe, BENCH_PEER_ADDR);
+
+    start = FEP_simNowUs();
+    for (i = 0; i < bench_packets; i++) {
+        for (j = 0; j < 4; j++) {
+            if (piping) {
+                fprintf(fep_pipeOut(&pipe), (j < 3) ? "%c=%lu " : "%c=%lu\n", 'a' + j, (unsigned long)i * (j + 1));
+            } else {
+                n = snprintf(buf, sizeof(buf), (j < 3) ? "%c=%lu " : "%c=%lu\n", 'a' + j, (unsigned long)i * (j + 1));
+                if (FEP_putbin(buf, n, BENCH_PEER_ADDR) != FEP_P0) failures++;
+            }
+        }
+        if (piping && ferror(fep_pipeOut(&pipe))) {
+            failures++;
+            clearerr(fep_pipeOut(&pipe));
+        }
+    }
+    t = FEP_simNowUs() - start;
+
+    FEP_simGetStats(0, &stats);
+    printf("{\"bench\":\"pipe\",\"mode\":\"%s\",\"lines\":%u,"
+           "\"throughput_lps\":%.2f,\"packets_on_air\":%u,\"failures\":%u}\n",
+           piping ? "pipe" : "write", bench_packets, bench_packets * 1e6 / t,
+           stats.sent, failures);
+}
+
+static void bench_e2eRx(uint8_t binary, uint16_t size) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    bench_node_t *peer = &bench_node[1];
+    uint64_t start, t, cycles = 0, c;
+    uint32_t received = 0;
+
+    bench_simStart(2, 0, 0);
+    bench_nodeInit(peer, 1, BENCH_MY_ADDR, size, bench_packets);
+    if (!binary) {
+        peer->cmdLen = snprintf(peer->cmd, sizeof(peer->cmd), "@TXT%03d", BENCH_MY_ADDR);
+        bench_fill(peer->cmd + peer->cmdLen, size, 0);
+        peer->cmdLen += size;
+        peer->cmd[peer->cmdLen++] = '\r';
+        peer->cmd[peer->cmdLen++] = '\n';
+    }
+    bench_nodeSend(peer);
+
+    start = FEP_simNowUs();
+    while (received < bench_packets && FEP_simNowUs() - start < 3600000000ULL) {
+        c = bench_cycles();
+        if (FEP_gets(buf, sizeof(buf)) != FEP_DT_ERR) {
+            cycles += bench_cycles() - c - bench_overhead;
+            received++;
+        } else {
+            FEP_hostDelayUs(100);
+        }
+    }
+    t = FEP_simNowUs() - start;
+
+    printf("{\"bench\":\"e2e-rx\",\"mode\":\"%s\",\"size\":%u,\"packets\":%u,"
+           "\"throughput_pps\":%.2f,\"throughput_Bps\":%.1f,"
+           "\"rx_handler_cycles_per_byte\":%.1f,\"gets_cycles_per_call\":%.1f,"
+           "\"rx_overflow\":%u}\n",
+           binary ? "bin" : "str", size, received,
+           received * 1e6 / t, received * (double)size * 1e6 / t,
+           bench_probe.bytes ? (double)bench_probe.cycles / bench_probe.bytes : 0.0,
+           received ? (double)cycles / received : 0.0,
+           FEP_getRxOverflow());
+}
+
+/*
+ * CPU benchmark without the simulator: the transport answers P0 at once
+ */
+static fep_rxhandler_t bench_echoHandler;
+static void *bench_echoArg;
+static uint64_t bench_echoBytes;
+static uint32_t bench_echoUs;
+
+static void bench_echoInit(void *ctx, uint32_t baud) {
+}
+
+static void bench_echoSetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) {
+    bench_echoHandler = handler;
+    bench_echoArg = arg;
+}
+
+static void bench_echoWrite(void *ctx, const uint8_t *buf, uint16_t len) {
+    bench_echoBytes += len;
+}
+
+static void bench_echoDelay(uint32_t us) {
+    /* FEP answers P0 whenever the driver waits */
+    (*bench_echoHandler)(bench_echoArg, 'P', 0);
+    (*bench_echoHandler)(bench_echoArg, '0', 0);
+    (*bench_echoHandler)(bench_echoArg, '\r', 0);
+    (*bench_echoHandler)(bench_echoArg, '\n', 0);
+
+    /* timer interrupt, so that the driver's clock advances */
+    for (bench_echoUs += us; bench_echoUs >= 1000; bench_echoUs -= 1000) {
+        FEP_tick();
+    }
+}
+
+static const fep_transport_t bench_echo = {
+    bench_echoInit, bench_echoSetRxHandler, bench_echoWrite, NULL
+};
+
+static void bench_cpuTx(uint8_t binary, uint16_t size) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    uint64_t start, cycles;
+    uint32_t i, n = bench_packets * 10;
+
+    FEP_hostSetDelay(bench_echoDelay);
+    FEP_hostSetSleep(NULL);
+    FEP_initTransport(&bench_echo, BENCH_MY_ADDR, 1, 2, 3, 0);
+    bench_fill(buf, size, binary);
+    bench_echoBytes = 0;
+
+    start = bench_cycles();
+    for (i = 0; i < n; i++) {
+        if (binary) {
+            FEP_putbin(buf, size, BENCH_PEER_ADDR);
+        } else {
+            FEP_puts(buf, BENCH_PEER_ADDR);
+        }
+    }
+    cycles = bench_cycles() - start;
+
+    printf("{\"bench\":\"cpu-tx\",\"mode\":\"%s\",\"size\":%u,\"calls\":%u,"
+           "\"cycles_per_call\":%.1f,\"cycles_per_byte\":%.2f}\n",
+           binary ? "bin" : "str", size, n,
+           (double)cycles / n, (double)cycles / bench_echoBytes);
+}
+
+static void bench_cpuRx(uint8_t binary, uint16_t size) {
+    char line[FEP_MAX_DATA_LEN + 32], buf[FEP_MAX_DATA_LEN + 1];
+    uint64_t start, handler = 0, gets = 0;
+    uint32_t i, j, n = bench_packets * 10, len;
+
+    FEP_hostSetDelay(bench_echoDelay);
+    FEP_hostSetSleep(NULL);
+    FEP_initTransport(&bench_echo, BENCH_MY_ADDR, 1, 2, 3, 0);
+    if (binary) {
+        len = snprintf(line, sizeof(line), "RBN%03d%03d", BENCH_PEER_ADDR, size);
+    } else {
+        len = snprintf(line, sizeof(line), "RXT%03d", BENCH_PEER_ADDR);
+    }
+    bench_fill(line + len, size, binary);
+    len += size;
+    memcpy(line + len, "120\r\n", 5);
+    len += 5;
+
+    for (i = 0; i < n; i++) {
+        start = bench_cycles();
+        for (j = 0; j < len; j++) {
+            (*bench_echoHandler)(bench_echoArg, (uint8_t)line[j], 0);
+        }
+        handler += bench_cycles() - start;
+
+        start = bench_cycles();
+        FEP_gets(buf, sizeof(buf));
+        gets += bench_cycles() - start;
+    }
+
+    printf("{\"bench\":\"cpu-rx\",\"mode\":\"%s\",\"size\":%u,\"packets\":%u,"
+           "\"rx_handler_cycles_per_byte\":%.2f,\"gets_cycles_per_call\":%.1f}\n",
+           binary ? "bin" : "str", size, n,
+           (double)handler / ((uint64_t)n * len), (double)gets / n);
+}
+
+/*
+ * urgent packets among saturated telemetry
+ */
+#define BENCH_TM_SIZE 250       /* telemetry packet */
+#define BENCH_TM_QUEUED 3       /* telemetry packets kept in the queue */
+
+static uint32_t bench_tmQueued, bench_tmSent, bench_tmStale;
+static uint32_t bench_urgentDone, bench_urgentFailures;
+static uint64_t bench_urgentAt;
+static uint8_t bench_urgentBusy;
+
+static void bench_tmCallback(uint8_t response, void *arg) {
+    bench_tmQueued--;
+    if (response == FEP_P0) bench_tmSent++;
+    if (response == FEP_DROPPED) bench_tmStale++;
+}
+
+static void bench_urgentCallback(uint8_t response, void *arg) {
+    bench_latency[bench_urgentDone++] = FEP_simNowUs() - bench_urgentAt;
+    if (response != FEP_P0) bench_urgentFailures++;
+    bench_urgentBusy = 0;
+}
+
+static void bench_prio(uint8_t prio, uint16_t n1, uint16_t maxAge) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    uint64_t start, next, t;
+
+    bench_simStart(2, n1, 0);
+    bench_fill(buf, BENCH_TM_SIZE, 1);
+    FEP_setTxQueue(FEP_PRIO_NORMAL, FEP_TX_QUEUE_DEPTH, maxAge);
+    bench_tmQueued = bench_tmSent = bench_tmStale = 0;
+    bench_urgentDone = bench_urgentFailures = 0;
+    bench_urgentBusy = 0;
+
+    start = FEP_simNowUs();
+    next = start + 100000;
+    while (bench_urgentDone < bench_packets && FEP_simNowUs() - start < 3600000000ULL) {
+        while (bench_tmQueued < BENCH_TM_QUEUED &&
+               FEP_putbinAsync(buf, BENCH_TM_SIZE, BENCH_PEER_ADDR, bench_tmCallback, NULL) == FEP_P1)
+        {
+            bench_tmQueued++;
+        }
+        if (!bench_urgentBusy && FEP_simNowUs() >= next) {
+            bench_urgentAt = FEP_simNowUs();
+            bench_urgentBusy = 1;
+            FEP_putsAsyncPrio("STOP", BENCH_PEER_ADDR, prio ? FEP_PRIO_URGENT : FEP_PRIO_NORMAL,
+                              bench_urgentCallback, NULL);
+            /* 200 ~ 300 ms apart, not in step with the telemetry */
+            next = bench_urgentAt + 200000 + (bench_urgentDone * 7919) % 100000;
+        }
+        FEP_poll();
+        FEP_hostSleep();
+    }
+    t = FEP_simNowUs() - start;
+
+    /* let the queue drain, so that the next case starts clean */
+    while (FEP_txPending() > 0) {
+        FEP_poll();
+        FEP_hostSleep();
+    }
+
+    qsort(bench_latency, bench_urgentDone, sizeof(bench_latency[0]), bench_compare);
+    printf("{\"bench\":\"prio\",\"mode\":\"%s\",\"n1_permille\":%u,\"max_age_ms\":%u,"
+           "\"urgent\":%u,\"lat_p50_us\":%u,\"lat_p99_us\":%u,\"lat_max_us\":%u,"
+           "\"urgent_failures\":%u,\"telemetry_pps\":%.2f,\"telemetry_stale\":%u}\n",
+           prio ? "prio" : "fifo", n1, maxAge, bench_urgentDone,
+           bench_percentile(bench_latency, bench_urgentDone, 50),
+           bench_percentile(bench_latency, bench_urgentDone, 99),
+           bench_latency[bench_urgentDone - 1],
+           bench_urgentFailures, bench_tmSent * 1e6 / t, bench_tmStale);
+}
+
+/*
+ * many nodes sending at once, with and without TDMA
+ */
+#define BENCH_TDMA_SIZE 64
+#define BENCH_TDMA_SLOT_MS 130  /* a try of BENCH_TDMA_SIZE bytes, ACK and guard */
+
+static void bench_tdmaCallback(uint8_t response, void *arg) {
+    if (response == FEP_P0) (*(uint32_t *)arg)++;
+}
+
+static void bench_tdma(uint8_t tdma, uint8_t nodes) {
+    static fep_t fep[FEP_SIM_MAX_NODES];
+    static uint32_t delivered[FEP_SIM_MAX_NODES];
+    char buf[FEP_MAX_DATA_LEN + 1];
+    fep_sim_stats_t stats;
+    uint64_t start, t;
+    uint32_t total = 0, slowest = 0xFFFFFFFF, tries = 0, n1 = 0, collisions = 0;
+    uint8_t i;
+
+    FEP_simInit(NULL);
+    for (i = 0; i < nodes; i++) {
+        FEP_simAddNode(BENCH_MY_ADDR + i);
+    }
+    for (i = 0; i < nodes; i++) {
+        fep_initTransport(&fep[i], FEP_simTransport(i), BENCH_MY_ADDR + i, 1, 2, 3, 0);
+        delivered[i] = 0;
+    }
+    if (tdma) {
+        /* node 0 receives and gives the beacons; its own slot isn't used */
+        fep_tdmaStart(&fep[0], nodes - 1, BENCH_TDMA_SLOT_MS, 0);
+        for (i = 1; i < nodes; i++) {
+            fep_tdmaJoin(&fep[i], i - 1);
+        }
+    }
+    bench_fill(buf, BENCH_TDMA_SIZE, 1);
+
+    start = FEP_simNowUs();
+    while ((t = FEP_simNowUs() - start) < (uint64_t)bench_packets * 100000) {
+        for (i = 1; i < nodes; i++) {
+            while (fep_putbinAsync(&fep[i], buf, BENCH_TDMA_SIZE, BENCH_MY_ADDR,
+                                   bench_tdmaCallback, &delivered[i]) == FEP_P1);
+            fep_poll(&fep[i]);
+        }
+        fep_poll(&fep[0]);
+        while (fep_gets(&fep[0], buf + BENCH_TDMA_SIZE, sizeof(buf) - BENCH_TDMA_SIZE) != FEP_DT_ERR);
+        FEP_hostSleep();
+    }
+
+    for (i = 1; i < nodes; i++) {
+        total += delivered[i];
+        if (delivered[i] < slowest) slowest = delivered[i];
+        FEP_simGetStats(i, &stats);
+        tries += stats.p0 + stats.n1 + stats.n3;
+        n1 += stats.n1;
+        collisions += stats.collisions;
+    }
+    printf("{\"bench\":\"tdma\",\"mode\":\"%s\",\"nodes\":%u,\"size\":%u,\"packets\":%u,"
+           "\"throughput_pps\":%.2f,\"throughput_Bps\":%.1f,\"slowest_node_pps\":%.2f,"
+           "\"n1_per_try_permille\":%u,\"collisions\":%u}\n",
+           tdma ? "tdma" : "csma", nodes, BENCH_TDMA_SIZE, total,
+           total * 1e6 / t, total * (double)BENCH_TDMA_SIZE * 1e6 / t, slowest * 1e6 / t,
+           tries ? (uint32_t)((uint64_t)n1 * 1000 / tries) : 0, collisions);
+}
+
+static void bench_sleep(uint16_t size, uint16_t n1) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    fep_sim_config_t config;
+    fep_sim_cpu_t start, end;
+    uint64_t active, sleep;
+    uint32_t i;
+
+    bench_simStart(2, n1, 0);
+    FEP_simDefaultConfig(&config);
+    bench_fill(buf, size, 1);
+
+    FEP_simGetCpu(&start);
+    for (i = 0; i < bench_packets; i++) {
+        FEP_putbin(buf, size, BENCH_PEER_ADDR);
+    }
+    FEP_simGetCpu(&end);
+    active = end.activeUs - start.activeUs;
+    sleep = end.sleepUs - start.sleepUs;
+
+    printf("{\"bench\":\"sleep\",\"size\":%u,\"n1_permille\":%u,\"packets\":%u,"
+           "\"active_us\":%llu,\"sleep_us\":%llu,\"wakeups\":%u,\"duty_pct\":%.2f,"
+           "\"avg_ua\":%.0f,\"busy_wait_ua\":%u}\n",
+           size, n1, bench_packets,
+           (unsigned long long)active, (unsigned long long)sleep, end.wakeups - start.wakeups,
+           100.0 * active / (active + sleep),
+           (double)(end.chargeUc - start.chargeUc) * 1e6 / (active + sleep),
+           config.cpuActiveUa);
+}
+
+int main(int argc, char **argv) {
+    static const uint16_t sizes[] = { 1, 16, 64, 128, 256 };
+    static const uint16_t rates[] = { 50, 200 };
+    static const uint8_t nodes[] = { 2, 4, 8 };
+    static const uint16_t messages[] = { 4, 8, 16 };
+    static const uint8_t meshes[] = { 2, 4, 8, 16 };
+    uint8_t binary, i, j;
+
+    if (argc > 1) bench_packets = atoi(argv[1]);
+    if (bench_packets == 0 || bench_packets > BENCH_MAX_PACKETS) bench_packets = 200;
+    bench_calibrate();
+
+    for (binary = 0; binary <= 1; binary++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            bench_cpuTx(binary, sizes[i]);
+            bench_cpuRx(binary, sizes[i]);
+        }
+    }
+
+    for (binary = 0; binary <= 1; binary++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            bench_e2eTx(binary, sizes[i], 2, 0, 0);
+            bench_e2eRx(binary, sizes[i]);
+        }
+    }
+
+    /* injected N1/N3 and node count with 64 bytes binary packets */
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        bench_e2eTx(1, 64, 2, rates[i], 0);
+        bench_e2eTx(1, 64, 2, 0, rates[i]);
+    }
+    for (j = 1; j < sizeof(nodes) / sizeof(nodes[0]); j++) {
+        bench_e2eTx(1, 64, nodes[j], 0, 0);
+    }
+
+    for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+        bench_batch(0, messages[i]);
+        bench_batch(1, messages[i]);
+    }
+    bench_pipe(0);
+    bench_pipe(1);
+
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        bench_prio(0, rates[i], 0);
+        bench_prio(1, rates[i], 0);
+    }
+    bench_prio(1, 200, 1000);
+
+    for (i = 0; i < sizeof(meshes) / sizeof(meshes[0]); i++) {
+        bench_tdma(0, meshes[i]);
+        bench_tdma(1, meshes[i]);
+    }
+
+    bench_sleep(16, 0);
+    bench_sleep(64, 0);
+    bench_sleep(64, 200);
+
+    return 0;
+}
@@ -1,64 +1,785 @@
+#if defined( FEP_HOST )
+#define _GNU_SOURCE /* fopencookie */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined( FEP_HOST )
+#include "fep_host.h"
+#else
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <avr/pgmspace.h>
+#if defined( FEP_IDLE_SLEEP )
+#include <avr/sleep.h>
+#endif
 
 #include "avr-uart/uart.h"
+#endif
 #include "fep.h"
 
+#if defined( FEP_HOST )
+/*
+ * replacements of avr-libc on the host.
+ * The rx handlers are called from FEP_hostDelayUs(), so there is no
+ * interrupt.
+ */
+#define cli()
+#define sei()
+#define ATOMIC_BLOCK(type)
+#define ATOMIC_RESTORESTATE
+#define _delay_ms(ms) FEP_hostDelayUs((uint32_t)((ms) * 1000))
+#define _delay_us(us) FEP_hostDelayUs((uint32_t)(us))
+#define PSTR(s) (s)
+#define fprintf_P fprintf
+#define sscanf_P sscanf
+#define _FDEV_EOF (-2)
+#endif
+
 /*
  * Macros and constants
  */
-#define FEP_LINE_LEN 273 /* 256(=maximam data length)+14(=header length)+2(=CRLF)+1(=null character) */
-#define FEP_TIMEOUT_MS 4000
+#define FEP_TIMEOUT_MS 4000     /* longest wait for the result of a packet */
+#define FEP_CMD_TIMEOUT_MS 1000 /* wait for the response to a local command */
 #define FEP_RETRY 10
 
+/* round trip time estimation (RFC 6298 with ms clock) */
+#define FEP_RTO_INIT_MS 1000    /* timeout until the first sample of a destination */
+#define FEP_RTO_MIN_MS 200     /* FEP may retry carrier sense by itself */
+#define FEP_BACKOFF_SLOT_MS 8   /* unit of the random wait before a retry */
+#define FEP_BACKOFF_MAX_EXP 4   /* the wait stops doubling after this */
+
+/* values known in fep_peer_t.known */
+#define FEP_PEER_RTT 0x01       /* srtt and rttvar */
+#define FEP_PEER_RX 0x02        /* intensity and seen */
+#define FEP_PEER_TX 0x04        /* delivery */
+#define FEP_PEER_ROUTE 0x08     /* route */
+#define FEP_PEER_GAIN 3         /* smoothing of intensity and delivery: 1 / 8 */
+#define FEP_ROUTE_PROBE 16      /* relayed packets before the direct link is tried again */
+
 #define FEP_SERIAL_TIMEOUT 5000
 
+#define FEP_BAUD 38400 /* bit rate between MCU and FEP at first */
+#define FEP_BOOT_TIMEOUT_MS 150 /* longest wait for FEP to answer at start */
+#define FEP_READY_POLL_MS 5     /* wait for the reply while FEP is starting */
+#define FEP_BAUD_PROBE_MS 30    /* wait for the reply at a bit rate */
+#define FEP_BAUD_CODES 5        /* values of FEP_REG_BAUD */
+
+#if (FEP_RX_QUEUE_DEPTH & (FEP_RX_QUEUE_DEPTH - 1)) != 0 || FEP_RX_QUEUE_DEPTH > 128
+#error "FEP_RX_QUEUE_DEPTH must be a power of two and not larger than 128"
+#endif
+#define FEP_RX_QUEUE_MASK (FEP_RX_QUEUE_DEPTH - 1)
+
+#if (FEP_TX_QUEUE_DEPTH & (FEP_TX_QUEUE_DEPTH - 1)) != 0 || FEP_TX_QUEUE_DEPTH > 128
+#error "FEP_TX_QUEUE_DEPTH must be a power of two and not larger than 128"
+#endif
+#define FEP_TX_QUEUE_MASK (FEP_TX_QUEUE_DEPTH - 1)
+
+#if FEP_TX_PRIORITIES < 1
+#error "FEP_TX_PRIORITIES must be 1 or more"
+#endif
+
+/* with FEP_UART_MODULE, the UART is called directly instead of through
+ * fep->transport */
+#if defined( FEP_UART_MODULE ) && !defined( FEP_HOST )
+#define FEP_UART_DIRECT
+#define FEP_UART_NAME_(n, name) FEP_uart##n##name
+#define FEP_UART_NAME(n, name) FEP_UART_NAME_(n, name)
+#define FEP_WRITE(fep, buf, len) ((void)(fep), FEP_UART_NAME(FEP_UART_MODULE, Write)(NULL, buf, len))
+#else
+#define FEP_WRITE(fep, buf, len) (*(fep)->transport->write)((fep)->transport->ctx, buf, len)
+#endif
+
+/* states of the asynchronous sender */
+#define FEP_TX_IDLE 0   /* nothing is being sent */
+#define FEP_TX_WAIT 1   /* waiting response of the packet at the tail of tx.prio */
+#define FEP_TX_BACKOFF 2 /* waiting before sending the packet again, or for the TDMA slot */
+#define FEP_TX_BEACON 3 /* waiting response of the TDMA beacon */
+
+#define FEP_REPLY_QUEUE_MASK (FEP_REPLY_QUEUE_DEPTH - 1)
+
+/* sequence numbers: 0 is sent only as the first packet after fep_init(),
+ * so that receivers notice the transmitter has restarted */
+#define FEP_SEQ_MASK 0x3F       /* sent as a character '0' + seq */
+#define FEP_SEQ_WINDOW 16       /* bits of fep_seqwin_t.window */
+#define FEP_SEQ_AGE_MS 10000    /* a transmitter silent for longer is forgotten */
+#define FEP_SEQ_NONE 0xFF       /* FEP_sendPacket(): no sequence number (TDMA beacon) */
+
+/* settings read by query commands: registers, bands of channel 1~3 and ID */
+#define FEP_ITEM_FRQ FEP_REG_COUNT
+#define FEP_ITEM_ID (FEP_REG_COUNT + 3)
+#define FEP_ITEM_COUNT (FEP_REG_COUNT + 4)
+
+/* bulk transfer packets: magic, kind, transfer number, fragment number,
+ * number of fragments, then data (FEP_BULK_DATA, FEP_BULK_LAST) or bitmap
+ * (FEP_BULK_ACK) */
+#define FEP_BULK_MAGIC 0xFE
+#define FEP_BULK_DATA 'D'
+#define FEP_BULK_LAST 'L'   /* the last data of a window: which fragments have arrived? */
+#define FEP_BULK_ACK 'A'
+
+/* batch of small messages: magic, then length and data of every message */
+#define FEP_BATCH_MAGIC 0xFD
+
+/* TDMA beacon: magic, slots in a frame, slot length [ms] (2 bytes, big
+ * endian). Broadcast by the coordinator at the start of every frame. */
+#define FEP_TDMA_MAGIC 0xFC
+#define FEP_TDMA_BEACON_LEN 4
+#if FEP_MAX_PAYLOAD < FEP_TDMA_BEACON_LEN
+#error "FEP_MAX_PAYLOAD is too small for the TDMA beacon"
+#endif
+#define FEP_TDMA_OFF 0
+#define FEP_TDMA_NODE 1
+#define FEP_TDMA_COORDINATOR 2
+#define FEP_TDMA_LISTEN_MS 10   /* a node waiting for the first beacon looks this often */
+
+/* flags of the settings other than registers in fep_t.cfg */
+#define FEP_CFG_FRQ(ch) FEP_PROFILE_FRQ(ch)    /* band of channel 1~3 */
+#define FEP_CFG_ID FEP_PROFILE_ID
+#define FEP_CFG_ALL (FEP_CFG_FRQ(1) | FEP_CFG_FRQ(2) | FEP_CFG_FRQ(3) | FEP_CFG_ID)
+
+/* states of the receive parser */
+#define FEP_RX_HEAD 0   /* command part of a line ("RXT", "RBN", "P0", ...) */
+#define FEP_RX_ADDR 1   /* transmitter's address (3 digits) */
+#define FEP_RX_LEN  2   /* length of binary data (3 digits) */
+#define FEP_RX_BIN  3   /* binary data */
+#define FEP_RX_INT  4   /* intensity after binary data (3 digits) */
+#define FEP_RX_TEXT 5   /* string data or other line until CRLF */
+#define FEP_RX_LF   6   /* received CR, waiting LF */
+#define FEP_RX_SKIP 7   /* broken line, discard until CRLF */
+
+/* the reader marks the frames from rxTail as in use, so that the rx handler
+ * doesn't drop the oldest of them (FEP_RX_DROP_OLDEST) */
+#if defined( FEP_RX_DROP_OLDEST )
+#define FEP_RX_HOLD(fep) ((fep)->rxHeld = 1)
+#define FEP_RX_UNHOLD(fep) ((fep)->rxHeld = 0)
+#else
+#define FEP_RX_HOLD(fep) do { } while (0)
+#define FEP_RX_UNHOLD(fep) do { } while (0)
+#endif
+
+/* counters of fep_t.stats, compiled out without FEP_STATS */
+#if defined( FEP_STATS )
+#if (FEP_STATS_INTENSITY_BINS & (FEP_STATS_INTENSITY_BINS - 1)) != 0 || FEP_STATS_INTENSITY_BINS > 256
+#error "FEP_STATS_INTENSITY_BINS must be a power of two and not larger than 256"
+#endif
+#define FEP_STAT_INC(fep, counter) do { if ((fep)->stats.counter != 0xFFFF) (fep)->stats.counter++; } while (0)
+#define FEP_STAT_RECEIVED(fep, type, intensity) FEP_statReceived((fep), (type), (intensity))
+#define FEP_STAT_TRIES(fep, tries) FEP_statTries((fep), (tries))
+#else
+#define FEP_STAT_INC(fep, counter) do { } while (0)
+#define FEP_STAT_RECEIVED(fep, type, intensity) do { } while (0)
+#define FEP_STAT_TRIES(fep, tries) ((void)(tries))
+#endif
+
 /*
  * private function prototypes
  */
 /******************************************************************************
 Function: FEP_getFrq1()
 Purpose:  get single frequency band setting
-Params:   channel number you want to read
+Params:   fep - module
+          ch - channel number you want to read
 Return:   band number
 ******************************************************************************/
-uint8_t FEP_getFrq1(uint8_t ch);
+static uint8_t FEP_getFrq1(fep_t *fep, uint8_t ch);
 
 /******************************************************************************
 Function: FEP_setFrq1()
 Purpose:  set single frequency band
-Params:   ch - channel number
+Params:   fep - module
+          ch - channel number
           band - band
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_setFrq1(uint8_t ch, uint8_t band);
+static uint8_t FEP_setFrq1(fep_t *fep, uint8_t ch, uint8_t band);
 
 /******************************************************************************
-Function: FEP_waitResponse()
-Purpose:  Loop until receive response from FEP
-Params:   none
+Function: FEP_sendQuery()
+Purpose:  send @REG, @FRQ or @IDR command (for internal use)
+Params:   fep - module
+          item - FEP_ITEM_xxx or register number
+Return:   none
+******************************************************************************/
+static void FEP_sendQuery(fep_t *fep, uint8_t item);
+
+/******************************************************************************
+Function: FEP_storeItem()
+Purpose:  store the reply to a query to the copy of the settings
+          (for internal use)
+Params:   fep - module
+          item - FEP_ITEM_xxx or register number
+          reply - reply from FEP
+Return:   FEP_P0, or FEP_N0 if the reply is broken
+******************************************************************************/
+static uint8_t FEP_storeItem(fep_t *fep, uint8_t item, const char *reply);
+
+/******************************************************************************
+Function: FEP_readItem()
+Purpose:  read a setting from FEP to the copy (for internal use)
+Params:   fep - module
+          item - FEP_ITEM_xxx or register number
+Return:   FEP_P0, or the response from FEP
+******************************************************************************/
+static uint8_t FEP_readItem(fep_t *fep, uint8_t item);
+
+/******************************************************************************
+Function: FEP_flushReplies()
+Purpose:  let the asynchronous try in flight finish, and forget replies
+          and responses which came too late for the previous command
+          (for internal use)
+Params:   fep - module
+Return:   none
+******************************************************************************/
+static void FEP_flushReplies(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_writeReg()
+Purpose:  send @REG command and update the copy of the register
+          (for internal use)
+Params:   fep - module
+          reg_num - register number
+          val - value to set
+Return:   response from FEP
+******************************************************************************/
+static uint8_t FEP_writeReg(fep_t *fep, uint8_t reg_num, uint8_t val);
+
+/******************************************************************************
+Function: FEP_writeFrq1()
+Purpose:  send @FRQ command and update the copy of the band (for internal use)
+Params:   fep - module
+          ch - channel number
+          band - band
+Return:   response from FEP
+******************************************************************************/
+static uint8_t FEP_writeFrq1(fep_t *fep, uint8_t ch, uint8_t band);
+
+/******************************************************************************
+Function: FEP_writeID()
+Purpose:  send @IDW command and update the copy of the ID (for internal use)
+Params:   fep - module
+          id - id value
+Return:   response from FEP
+******************************************************************************/
+static uint8_t FEP_writeID(fep_t *fep, uint16_t id);
+
+/******************************************************************************
+Function: FEP_txEnqueue()
+Purpose:  add a packet to the asynchronous send queue (for internal use)
+Params:   fep - module
+          type - FEP_DT_STR or FEP_DT_BIN
+          data - string or binary array
+          len - size of data
+          addr - receiver's address
+          prio - priority
+          cb - callback
+          arg - argument of callback
+Return:   FEP_P1 if queued, FEP_N3 if the queue is full,
+          FEP_N0 if the data is too long or prio is wrong
+******************************************************************************/
+static uint8_t FEP_txEnqueue(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg);
+
+/******************************************************************************
+Function: FEP_tdmaWait()
+Purpose:  get the time until a try may start in the own TDMA slot
+          (for internal use)
+Params:   fep - module
+          len - size of the packet
+          hops - repeaters on the way
+Return:   time to wait [ms], 0 if the try may start now
+******************************************************************************/
+static uint16_t FEP_tdmaWait(fep_t *fep, size_t len, uint8_t hops);
+
+/******************************************************************************
+Function: FEP_tdmaBeacon()
+Purpose:  broadcast the beacon of a TDMA frame if it is due (for internal use)
+Params:   fep - module
+          now - FEP_millis()
+Return:   1 if the beacon has been sent, otherwise 0
+******************************************************************************/
+static uint8_t FEP_tdmaBeacon(fep_t *fep, uint32_t now);
+
+/******************************************************************************
+Function: FEP_txNext()
+Purpose:  drop the stale packets at the tails of the asynchronous send
+          queues and find the queue to be sent next (for internal use)
+Params:   fep - module
+          now - FEP_millis()
+Return:   priority of the queue, or FEP_TX_PRIORITIES if all are empty
+******************************************************************************/
+static uint8_t FEP_txNext(fep_t *fep, uint32_t now);
+
+/******************************************************************************
+Function: FEP_txPoll()
+Purpose:  progress the asynchronous sending (the part of fep_poll() which
+          the blocking send functions call while they wait)
+Params:   fep - module
+Return:   none
+******************************************************************************/
+static void FEP_txPoll(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_txDrain()
+Purpose:  let the asynchronous try in flight finish, so that a blocking
+          command doesn't take its response (for internal use)
+Params:   fep - module
+Return:   none
+******************************************************************************/
+static void FEP_txDrain(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_dispatch()
+Purpose:  pass the received frames to their handlers (for internal use)
+Params:   fep - module
+Return:   none
+******************************************************************************/
+static void FEP_dispatch(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_handlerFind()
+Purpose:  find the most specific handler of a frame (for internal use)
+Params:   fep - module
+          addr - transmitter's address
+          type - FEP_DT_xxx of the frame
+Return:   entry of the handler table, or NULL if there is none
+******************************************************************************/
+static fep_dispatch_t *FEP_handlerFind(fep_t *fep, uint8_t addr, uint8_t type);
+
+/******************************************************************************
+Function: FEP_send()
+Purpose:  send a packet with retries and wait the result (for internal use)
+Params:   fep - module
+          type - FEP_DT_STR or FEP_DT_BIN
+          data - string or binary array
+          len - size of data
+          addr - receiver's address
+          timeout - time for all tries [ms] (0: no limit)
+Return:   response from FEP
+******************************************************************************/
+static uint8_t FEP_send(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, uint16_t timeout);
+
+/******************************************************************************
+Function: FEP_sendVia()
+Purpose:  FEP_send() on the given path (for internal use)
+Params:   same as FEP_send()
+          route - repeaters, or NULL to choose by the route of the peer
+          limit - tries at most (FEP_RETRY, 1 for a fragment of
+                  fep_sendBulk())
+Return:   response from FEP
+******************************************************************************/
+static uint8_t FEP_sendVia(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, const fep_route_t *route, uint8_t limit, uint16_t timeout);
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: FEP_bulkWaitAck()
+Purpose:  wait for the answer to FEP_BULK_LAST and merge its bitmap
+          (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          id - number of the transfer
+          count - number of fragments
+          acked - bitmap of the fragments which have arrived
+Return:   FEP_P0 if answered, or FEP_NO_RESPONSE
+******************************************************************************/
+static uint8_t FEP_bulkWaitAck(fep_t *fep, uint8_t addr, uint8_t id, uint8_t count, uint8_t *acked);
+
+/******************************************************************************
+Function: FEP_bulkTakeAck()
+Purpose:  take the answers to FEP_BULK_LAST out of the receive queue
+          (for internal use)
+Params:   same as FEP_bulkWaitAck()
+Return:   1 if an answer has been found, otherwise 0
+******************************************************************************/
+static uint8_t FEP_bulkTakeAck(fep_t *fep, uint8_t addr, uint8_t id, uint8_t count, uint8_t *acked);
+
+/******************************************************************************
+Function: FEP_bulkMissing()
+Purpose:  count the fragments which haven't arrived (for internal use)
+Params:   bitmap - bit n: fragment n has arrived
+          count - number of fragments
+Return:   number of missing fragments
+******************************************************************************/
+static uint8_t FEP_bulkMissing(const uint8_t *bitmap, uint8_t count);
+
+/******************************************************************************
+Function: FEP_pipeSend()
+Purpose:  send a packet of fep_pipeOut() (for internal use)
+Params:   pipe - state of the streams
+          data - data of the packet
+          len - size of data
 Return:   response from FEP
 ******************************************************************************/
-static uint8_t FEP_waitResponse(void);
+static uint8_t FEP_pipeSend(fep_pipe_t *pipe, const char *data, uint16_t len);
+
+/******************************************************************************
+Function: FEP_pipeGet()
+Purpose:  read a byte of the packets from the peer of fep_pipeIn() (for
+          internal use)
+Params:   pipe - state of the streams
+Return:   byte, or -1 if there is none now
+******************************************************************************/
+static int FEP_pipeGet(fep_pipe_t *pipe);
+
+#if defined( FEP_HOST )
+/******************************************************************************
+Function: FEP_pipeWrite()
+Purpose:  send what stdio has buffered in fep_pipeOut() (cookie write)
+Params:   cookie - fep_pipe_t
+          buf - bytes to be sent
+          size - number of bytes
+Return:   size, or -1 if a packet isn't delivered
+******************************************************************************/
+static ssize_t FEP_pipeWrite(void *cookie, const char *buf, size_t size);
+
+/******************************************************************************
+Function: FEP_pipeRead()
+Purpose:  read the packets from the peer for fep_pipeIn() (cookie read)
+Params:   cookie - fep_pipe_t
+          buf - variable for storing the bytes
+          size - size of buf
+Return:   number of bytes (0: none now)
+******************************************************************************/
+static ssize_t FEP_pipeRead(void *cookie, char *buf, size_t size);
+#else
+/******************************************************************************
+Function: FEP_pipePutc()
+Purpose:  buffer a character of fep_pipeOut(), and send the packet when it
+          is full or at a newline
+Params:   c - character to be sent
+          stream - fep_pipeOut()
+Return:   0, or _FDEV_ERR if the packet isn't delivered
+******************************************************************************/
+static int FEP_pipePutc(char c, FILE *stream);
+
+/******************************************************************************
+Function: FEP_pipeGetc()
+Purpose:  read a character of fep_pipeIn()
+Params:   stream - fep_pipeIn()
+Return:   character, or _FDEV_EOF if there is none now
+******************************************************************************/
+static int FEP_pipeGetc(FILE *stream);
+#endif
+#endif
+
+/******************************************************************************
+Function: FEP_wireTime()
+Purpose:  estimate the time to send the command to FEP and the packet on air
+          (for internal use)
+Params:   fep - module
+          len - size of data
+Return:   time [ms]
+******************************************************************************/
+static uint16_t FEP_wireTime(fep_t *fep, size_t len);
+
+/******************************************************************************
+Function: FEP_baudCode()
+Purpose:  get the value of FEP_REG_BAUD for a bit rate (for internal use)
+Params:   baud - bit rate [bps]
+Return:   value, or FEP_BAUD_CODES if the rate isn't supported
+******************************************************************************/
+static uint8_t FEP_baudCode(uint32_t baud);
+
+#if !defined( FEP_HOST )
+/******************************************************************************
+Function: FEP_baudError()
+Purpose:  get the difference between a bit rate and the one made by the
+          UART from F_CPU (for internal use)
+Params:   select - setting of uartN_init() (UART_BAUD_SELECT() or
+                   UART_BAUD_SELECT_DOUBLE_SPEED())
+          baud - bit rate [bps]
+Return:   difference [1/1000]
+******************************************************************************/
+static uint16_t FEP_baudError(uint16_t select, uint32_t baud);
+#endif
+
+/******************************************************************************
+Function: FEP_baudUsable()
+Purpose:  check that the UART can make a bit rate (for internal use)
+Params:   baud - bit rate [bps]
+Return:   1 if the difference is within FEP_BAUD_ERROR_PERMILLE
+******************************************************************************/
+static uint8_t FEP_baudUsable(uint32_t baud);
+
+/******************************************************************************
+Function: FEP_switchBaud()
+Purpose:  switch the UART to a bit rate (for internal use)
+Params:   fep - module
+          baud - bit rate [bps]
+Return:   none
+******************************************************************************/
+static void FEP_switchBaud(fep_t *fep, uint32_t baud);
+
+/******************************************************************************
+Function: FEP_start()
+Purpose:  initialize the module and the transport, and wait until FEP
+          answers at a bit rate (for internal use)
+Params:   fep - module
+          transport - serial port connected to FEP
+Return:   1 if FEP has answered, otherwise 0
+******************************************************************************/
+static uint8_t FEP_start(fep_t *fep, const fep_transport_t *transport);
+
+/******************************************************************************
+Function: FEP_waitReady()
+Purpose:  ask FEP until it answers or FEP_BOOT_TIMEOUT_MS passes
+          (for internal use)
+Params:   fep - module
+Return:   1 if FEP has answered, otherwise 0
+******************************************************************************/
+static uint8_t FEP_waitReady(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_ping()
+Purpose:  ask FEP its address at the current bit rate (for internal use)
+Params:   fep - module
+          timeout - time to wait for the reply [ms]
+Return:   1 if FEP has answered, otherwise 0
+******************************************************************************/
+static uint8_t FEP_ping(fep_t *fep, uint16_t timeout);
+
+#if !defined( FEP_NO_QUERY )
+/******************************************************************************
+Function: FEP_readItems()
+Purpose:  read settings with the queries sent back to back (for internal use)
+Params:   fep - module
+          regs - bit n: read register n
+          other - FEP_CFG_xxx: read the bands and the ID
+Return:   FEP_P0, or the response from FEP if a query failed
+******************************************************************************/
+static uint8_t FEP_readItems(fep_t *fep, uint32_t regs, uint8_t other);
+
+/******************************************************************************
+Function: FEP_itemSelected()
+Purpose:  check whether a setting is selected to read (for internal use)
+Params:   item - register number, FEP_ITEM_FRQ + channel - 1 or FEP_ITEM_ID
+          regs - bit n: register n is selected
+          other - FEP_CFG_xxx: the bands and the ID selected
+Return:   1 if selected, otherwise 0
+******************************************************************************/
+static uint8_t FEP_itemSelected(uint8_t item, uint32_t regs, uint8_t other);
+#endif
+
+/******************************************************************************
+Function: FEP_probeBaud()
+Purpose:  switch the UART to a bit rate and ask FEP its address
+          (for internal use)
+Params:   fep - module
+          baud - bit rate [bps]
+Return:   1 if FEP has answered, otherwise 0
+******************************************************************************/
+static uint8_t FEP_probeBaud(fep_t *fep, uint32_t baud);
+
+/******************************************************************************
+Function: FEP_peerFind()
+Purpose:  find the entry of a peer (for internal use)
+Params:   fep - module
+          addr - address of the peer
+Return:   entry, or NULL if the peer is unknown
+******************************************************************************/
+static fep_peer_t *FEP_peerFind(fep_t *fep, uint8_t addr);
+
+/******************************************************************************
+Function: FEP_peerGet()
+Purpose:  find the entry of a peer, or replace the least recently used one
+          with an empty entry of the peer (for internal use)
+Params:   fep - module
+          addr - address of the peer
+Return:   entry
+******************************************************************************/
+static fep_peer_t *FEP_peerGet(fep_t *fep, uint8_t addr);
+
+/******************************************************************************
+Function: FEP_peerReceived()
+Purpose:  add the intensity of a packet from a peer, or learn the route to
+          the peer from a relayed packet (for internal use)
+Params:   fep - module
+          frame - received packet
+Return:   none
+******************************************************************************/
+static void FEP_peerReceived(fep_t *fep, const fep_frame_t *frame);
+
+/******************************************************************************
+Function: FEP_routePick()
+Purpose:  choose the path of a try to a peer (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          first - 1 for the first try of a packet
+          route - variable for storing the path (hops 0: direct)
+Return:   none
+******************************************************************************/
+static void FEP_routePick(fep_t *fep, uint8_t addr, uint8_t first, fep_route_t *route);
+
+/******************************************************************************
+Function: FEP_routeResult()
+Purpose:  switch the path to a peer after the result of a try on it
+          (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          relayed - the try went through repeaters
+          response - response from FEP
+Return:   none
+******************************************************************************/
+static void FEP_routeResult(fep_t *fep, uint8_t addr, uint8_t relayed, uint8_t response);
+
+/******************************************************************************
+Function: FEP_peerResult()
+Purpose:  add the result of a try to send to a peer (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          response - response from FEP. Only P0 and N1 are about the link.
+Return:   none
+******************************************************************************/
+static void FEP_peerResult(fep_t *fep, uint8_t addr, uint8_t response);
+
+/******************************************************************************
+Function: FEP_rttTimeout()
+Purpose:  get the time to wait the result of a try (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          len - size of data
+          hops - number of repeaters on the path
+          retry - number of tries which timed out or failed before
+Return:   timeout [ms]
+******************************************************************************/
+static uint16_t FEP_rttTimeout(fep_t *fep, uint8_t addr, size_t len, uint8_t hops, uint8_t retry);
+
+/******************************************************************************
+Function: FEP_rttUpdate()
+Purpose:  add a sample of round trip time of a destination (for internal use)
+Params:   fep - module
+          addr - receiver's address
+          len - size of data
+          elapsed - time from sending the command to P0 [ms]
+Return:   none
+******************************************************************************/
+static void FEP_rttUpdate(fep_t *fep, uint8_t addr, size_t len, uint16_t elapsed);
+
+/******************************************************************************
+Function: FEP_backoff()
+Purpose:  get a random time to wait before the next try (for internal use)
+Params:   fep - module
+          retry - number of failed tries
+Return:   time [ms]
+******************************************************************************/
+static uint16_t FEP_backoff(fep_t *fep, uint8_t retry);
+
+/******************************************************************************
+Function: FEP_sendPacket()
+Purpose:  write @TXT, @TBN or their relayed forms (@TXR, @TBR, @TX2, @TB2)
+          to FEP (for internal use)
+Params:   fep - module
+          type - FEP_DT_STR or FEP_DT_BIN
+          data - string or binary array
+          len - size of data
+          addr - receiver's address
+          route - repeaters (hops 0: direct)
+          seq - sequence number (sent if fep_setSequence() is on), or
+                FEP_SEQ_NONE
+Return:   none
+******************************************************************************/
+static void FEP_sendPacket(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, const fep_route_t *route, uint8_t seq);
+
+/******************************************************************************
+Function: FEP_maxDataLen()
+Purpose:  get the longest data of a packet (for internal use)
+Params:   fep - module
+Return:   length [bytes]
+******************************************************************************/
+static uint16_t FEP_maxDataLen(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_nextSeq()
+Purpose:  take the sequence number of a new packet (for internal use)
+Params:   fep - module
+Return:   sequence number
+******************************************************************************/
+static uint8_t FEP_nextSeq(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_putDec3()
+Purpose:  write 3 digits decimal number (for internal use)
+Params:   p - buffer (3 bytes)
+          val - value (0~999)
+Return:   none
+******************************************************************************/
+static void FEP_putDec3(char *p, uint16_t val);
+
+/******************************************************************************
+Function: FEP_takeResponse()
+Purpose:  get the response from the mailbox and empty it (for internal use)
+Params:   fep - module
+Return:   response from FEP or FEP_NO_RESPONSE
+******************************************************************************/
+static uint8_t FEP_takeResponse(fep_t *fep);
+
+/******************************************************************************
+Function: FEP_millis()
+Purpose:  get the clock of the library: the time counted by FEP_tick(), or
+          the time waited by FEP_idle() until FEP_tick() runs (for internal
+          use)
+Params:   none
+Return:   time in ms
+******************************************************************************/
+static uint32_t FEP_millis(void);
+
+/******************************************************************************
+Function: FEP_idle()
+Purpose:  Wait a little while waiting for FEP (for internal use). Sleeps
+          until the next interrupt with FEP_IDLE_SLEEP once FEP_tick() runs,
+          otherwise waits 1 ms and advances the clock if FEP_tick() doesn't.
+Params:   none
+Return:   none
+******************************************************************************/
+static void FEP_idle(void);
+
+/******************************************************************************
+Function: FEP_sleepMs()
+Purpose:  wait for a time with FEP_idle() (for internal use)
+Params:   ms - time [ms]
+Return:   none
+******************************************************************************/
+static void FEP_sleepMs(uint16_t ms);
+
+/******************************************************************************
+Function: FEP_waitResponse()
+Purpose:  Loop until receive the final response from FEP. P1 (accepted) is
+          skipped.
+Params:   fep - module
+          timeout - time to wait [ms]
+          elapsed - variable for storing the time waited [ms] (can be NULL)
+Return:   response from FEP or FEP_NO_RESPONSE
+******************************************************************************/
+static uint8_t FEP_waitResponse(fep_t *fep, uint16_t timeout, uint16_t *elapsed);
 
 /******************************************************************************
 Function: FEP_waitResponseStr()
-Purpose:  Loop until receive response from FEP and store response string to buffer
-Params:   buf - buffer for storing the response from FEP
-          len - size of response you want to read(< size of buf - 3).
-Return:   number of character that has been stored
+Purpose:  Loop until receive the reply to a query from FEP and store the
+          oldest reply string to buffer. Returns as soon as it is received.
+Params:   fep - module
+          buf - buffer for storing the reply (FEP_REPLY_LEN + 1 bytes)
+          timeout - time to wait [ms]
+Return:   FEP_P0 if a reply has been stored, the response from FEP if the
+          query is refused (P0 and P1 are results of earlier commands and
+          are skipped), or FEP_NO_RESPONSE
+******************************************************************************/
+static uint8_t FEP_waitResponseStr(fep_t *fep, char *buf, uint16_t timeout);
+
+/******************************************************************************
+Function: FEP_rxDecode()
+Purpose:  decode a byte from FEP (fep_rxHandler registered to the transport)
+Params:   arg - module given to setRxHandler
+          data - newest data from uart
+          error - error of uart
+Return:   none
 ******************************************************************************/
-static char *FEP_waitResponseStr(char *buf, size_t len);
+static void FEP_rxDecode(void *arg, uint8_t data, uint8_t error);
 
 /******************************************************************************
 Function: FEP_io_getchar()
 Purpose:  get a character from UART
-Params:   stream
+Params:   stream - stream of the module
 Return:   received character from UART
 ******************************************************************************/
 int FEP_io_getchar(FILE *stream);
@@ -67,40 +788,149 @@ int FEP_io_getchar(FILE *stream);
 Function: FEP_io_putchar()
 Purpose:  send a character via UART
 Params:   c - character to be sent
-          stream
+          stream - stream of the module
 Return:
 ******************************************************************************/
 int FEP_io_putchar(char c, FILE *stream);
 
 /******************************************************************************
-Function: FEP_fgets()
-Purpose:  get string (for internal use)
-Params:   stream
-Return:   received character from UART
+Function: FEP_rxStore()
+Purpose:  store a character of the line being received (for internal use)
+Params:   fep - module
+          frame - slot of the receive queue being filled
+          c - character
+Return:   none
+******************************************************************************/
+static void FEP_rxStore(fep_t *fep, volatile fep_frame_t *frame, uint8_t c);
+
+/******************************************************************************
+Function: FEP_rxEndLine()
+Purpose:  dispatch the line that has been received (for internal use)
+Params:   fep - module
+          frame - slot of the receive queue being filled
+Return:   none
 ******************************************************************************/
-char *FEP_fgets(char * s, int n, FILE * stream);
+static void FEP_rxEndLine(fep_t *fep, volatile fep_frame_t *frame);
+
+/******************************************************************************
+Function: FEP_rxDuplicate()
+Purpose:  check the sequence number of a received packet against the
+          window of the transmitter, and record it (for internal use)
+Params:   fep - module
+          addr - transmitter's address
+          c - sequence number character of the packet
+Return:   1 if the packet has been received before, otherwise 0
+******************************************************************************/
+static uint8_t FEP_rxDuplicate(fep_t *fep, uint8_t addr, uint8_t c);
+
+#if defined( FEP_STATS )
+/******************************************************************************
+Function: FEP_statReceived()
+Purpose:  count a packet put to the receive queue (for internal use)
+Params:   fep - module
+          type - FEP_DT_STR or FEP_DT_BIN
+          intensity - electric field intensity of the packet
+Return:   none
+******************************************************************************/
+static void FEP_statReceived(fep_t *fep, uint8_t type, uint16_t intensity);
+
+/******************************************************************************
+Function: FEP_statTries()
+Purpose:  count a finished packet in the tries histogram (for internal use)
+Params:   fep - module
+          n - number of times the packet was sent
+Return:   none
+******************************************************************************/
+static void FEP_statTries(fep_t *fep, uint8_t n);
+#endif
 
 /*
  *  Module global variables
  */
-static volatile int16_t FEP_intensity;
-static volatile uint8_t FEP_availableFlag;
-static volatile char FEP_latestPacket[FEP_LINE_LEN];
-static volatile uint8_t FEP_transmitterAddr;
-void (*FEP_uart_init)(uint16_t baudrate);
-void (*FEP_uart_setRxHandler)(void (*func)(uint8_t data, uint8_t lastRxError));
-uint16_t (*FEP_uart_getc)(void);
-uint16_t (*FEP_uart_peek)(void);
-void (*FEP_uart_putc)(uint8_t data);
-uint16_t (*FEP_uart_available)(void);
-void (*FEP_uart_flush)(uint16_t n);
-
-FILE fepio = FDEV_SETUP_STREAM(FEP_io_putchar, FEP_io_getchar, _FDEV_SETUP_RW);
+fep_t FEP_default;
+static volatile uint32_t FEP_ms;     /* clock of the library (see FEP_millis()) */
+static volatile uint8_t FEP_ticking; /* FEP_tick() has been called */
+static uint16_t FEP_seed;   /* state of the random numbers for backoff */
+/* bit rates of the values of FEP_REG_BAUD [100 bps] */
+static const uint16_t FEP_baudRates[FEP_BAUD_CODES] = { 96, 192, 384, 576, 1152 };
+
+#if !defined( FEP_HOST )
+/*
+ * avr-uart modules as transports.
+ * avr-uart stores every byte to its ring buffer before it calls the rx
+ * handler. The byte is decoded by fep_rxHandler, so remove it from the ring.
+ * The handler and its module are kept for every UART.
+ */
+#if defined( FEP_UART_HAS_WRITE )
+#define FEP_UART_WRITE(n, buf, len) uart##n##_write(buf, len)
+#else
+#define FEP_UART_WRITE(n, buf, len) while (len--) uart##n##_putc(*buf++)
+#endif
+
+/* setting of uartN_init() for a bit rate: normal or double speed, whichever
+ * makes the closer rate */
+static uint16_t FEP_uartBaudSelect(uint32_t baud) {
+    if (FEP_baudError(UART_BAUD_SELECT_DOUBLE_SPEED(baud, F_CPU), baud) <
+        FEP_baudError(UART_BAUD_SELECT(baud, F_CPU), baud))
+    {
+        return UART_BAUD_SELECT_DOUBLE_SPEED(baud, F_CPU);
+    }
+    return UART_BAUD_SELECT(baud, F_CPU);
+}
+
+/* the handler is always FEP_rxDecode() when there is only one UART */
+#if defined( FEP_UART_DIRECT )
+#define FEP_UART_HANDLER(n, data, error) FEP_rxDecode(FEP_uart##n##Arg, data, error)
+#else
+#define FEP_UART_HANDLER(n, data, error) (*FEP_uart##n##Handler)(FEP_uart##n##Arg, data, error)
+#endif
+
+#define FEP_UART_TRANSPORT(n) \
+    static fep_rxhandler_t FEP_uart##n##Handler; \
+    static void *FEP_uart##n##Arg; \
+    static void FEP_uart##n##Rx(uint8_t data, uint8_t error) { \
+        uart##n##_getc(); \
+        FEP_UART_HANDLER(n, data, error); \
+    } \
+    static void FEP_uart##n##Init(void *ctx, uint32_t baud) { \
+        uart##n##_init(FEP_uartBaudSelect(baud)); \
+    } \
+    static void FEP_uart##n##SetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) { \
+        FEP_uart##n##Handler = handler; \
+        FEP_uart##n##Arg = arg; \
+        uart##n##_setRxHandler(FEP_uart##n##Rx); \
+    } \
+    static void FEP_uart##n##Write(void *ctx, const uint8_t *buf, uint16_t len) { \
+        FEP_UART_WRITE(n, buf, len); \
+    } \
+    static const fep_transport_t FEP_uart##n = { \
+        FEP_uart##n##Init, FEP_uart##n##SetRxHandler, FEP_uart##n##Write, NULL \
+    };
+#define FEP_UART_TRANSPORT_OF(n) FEP_UART_TRANSPORT(n)
+
+#if defined( FEP_UART_DIRECT )
+FEP_UART_TRANSPORT_OF(FEP_UART_MODULE)
+#else
+#if defined( USART0_ENABLED )
+FEP_UART_TRANSPORT(0)
+#endif
+#if defined( USART1_ENABLED )
+FEP_UART_TRANSPORT(1)
+#endif
+#if defined( USART2_ENABLED )
+FEP_UART_TRANSPORT(2)
+#endif
+#if defined( USART3_ENABLED )
+FEP_UART_TRANSPORT(3)
+#endif
+#endif /* FEP_UART_DIRECT */
+#endif /* !FEP_HOST */
 
 /*
  * functions
  */
-void FEP_init(
+void fep_init(
+    fep_t *fep,
     uint8_t module,
     uint8_t addr,
     uint8_t ch1,
@@ -108,446 +938,2700 @@ void FEP_init(
     uint8_t ch3,
     uint16_t id)
 {
-    /* disable interrupt */
-    cli();
+    const fep_transport_t *transport = fep_uart(module);
+
+    /* error! The module # is wrong! */
+    if (transport == NULL) return;
+
+    fep_initTransport(fep, transport, addr, ch1, ch2, ch3, id);
+}
+
+const fep_transport_t *fep_uart(uint8_t module) {
+#if defined( FEP_UART_DIRECT )
+    return (module == FEP_UART_MODULE) ? &FEP_UART_NAME(FEP_UART_MODULE, ) : NULL;
+#else
+    switch (module) {
+#if defined( USART0_ENABLED ) && !defined( FEP_HOST )
+        case 0:
+            return &FEP_uart0;
+#endif
+#if defined( USART1_ENABLED ) && !defined( FEP_HOST )
+        case 1:
+            return &FEP_uart1;
+#endif
+#if defined( USART2_ENABLED ) && !defined( FEP_HOST )
+        case 2:
+            return &FEP_uart2;
+#endif
+#if defined( USART3_ENABLED ) && !defined( FEP_HOST )
+        case 3:
+            return &FEP_uart3;
+#endif
+        default:
+            return NULL;
+    }
+#endif
+}
+
+void fep_initTransport(
+    fep_t *fep,
+    const fep_transport_t *transport,
+    uint8_t addr,
+    uint8_t ch1,
+    uint8_t ch2,
+    uint8_t ch3,
+    uint16_t id)
+{
+    fep_profile_t profile;
+
+    fep_profileInit(&profile, addr, ch1, ch2, ch3, id);
+    fep_initProfile(fep, transport, &profile);
+}
+
+uint8_t fep_initProfile(fep_t *fep, const fep_transport_t *transport, const fep_profile_t *profile) {
+    uint32_t start = FEP_millis();
+    uint8_t response = FEP_NO_RESPONSE;
+
+    if (FEP_start(fep, transport)) response = fep_applyProfile(fep, profile);
+    fep->bootMs = FEP_millis() - start;
+
+    return response;
+}
+
+void fep_profileInit(fep_profile_t *profile, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id) {
+    memset(profile, 0, sizeof(*profile));
+    /* add intensity to received packets */
+    profile->set = FEP_PROFILE_INTENSITY;
+    if (addr != FEP_KEEP) {
+        profile->regMask = (uint32_t)1 << 0;
+        profile->reg[0] = addr;
+    }
+    if (ch1 != FEP_KEEP) profile->set |= FEP_PROFILE_FRQ(1);
+    if (ch2 != FEP_KEEP) profile->set |= FEP_PROFILE_FRQ(2);
+    if (ch3 != FEP_KEEP) profile->set |= FEP_PROFILE_FRQ(3);
+    if (id != FEP_KEEP_ID) profile->set |= FEP_PROFILE_ID;
+    profile->frq[0] = ch1;
+    profile->frq[1] = ch2;
+    profile->frq[2] = ch3;
+    profile->id = id;
+}
+
+uint8_t fep_applyProfile(fep_t *fep, const fep_profile_t *profile) {
+    uint32_t bit, regs = profile->regMask;
+    uint8_t i, val;
+#if !defined( FEP_NO_QUERY )
+    uint8_t response;
+#endif
+
+    if (profile->set & FEP_PROFILE_INTENSITY) regs |= (uint32_t)1 << FEP_REG_INTENSITY;
+
+#if !defined( FEP_NO_QUERY )
+    /* read what the profile sets and isn't known yet */
+    response = FEP_readItems(fep, regs & ~fep->cfg.regValid, profile->set & FEP_CFG_ALL & ~fep->cfg.valid);
+    if (response != FEP_P0) return response;
+#endif
+
+    /* write the differences (and what is still unknown) with one reset */
+    fep_beginConfig(fep);
+    for (i = 0; i < FEP_REG_COUNT; i++) {
+        bit = (uint32_t)1 << i;
+        if ((profile->regMask & bit) && (!(fep->cfg.regValid & bit) || fep->cfg.reg[i] != profile->reg[i])) {
+            fep_setReg(fep, i, profile->reg[i]);
+        }
+    }
+    if (profile->set & FEP_PROFILE_INTENSITY) {
+        /* only the bit of intensity; the rest of the register is kept */
+        bit = (uint32_t)1 << FEP_REG_INTENSITY;
+        val = (fep->cfg.regValid & bit) ? fep->cfg.reg[FEP_REG_INTENSITY] : 0;
+        if (!(fep->cfg.regValid & bit) || !(val & (1 << 7))) fep_setReg(fep, FEP_REG_INTENSITY, val | (1 << 7));
+    }
+    for (i = 1; i <= 3; i++) {
+        if (!(profile->set & FEP_CFG_FRQ(i))) continue;
+        if (!(fep->cfg.valid & FEP_CFG_FRQ(i)) || fep->cfg.frq[i - 1] != profile->frq[i - 1]) {
+            FEP_setFrq1(fep, i, profile->frq[i - 1]);
+        }
+    }
+    if ((profile->set & FEP_CFG_ID) && (!(fep->cfg.valid & FEP_CFG_ID) || fep->cfg.id != profile->id)) {
+        fep_setID(fep, profile->id);
+    }
+
+    return fep_commitConfig(fep);
+}
+
+uint16_t fep_getBootTime(fep_t *fep) {
+    return fep->bootMs;
+}
+
+static uint8_t FEP_start(fep_t *fep, const fep_transport_t *transport) {
+    uint32_t baud;
+    uint8_t i;
+
+#if defined( FEP_UART_DIRECT )
+    /* the library writes only to FEP_UART_MODULE */
+    if (transport != fep_uart(FEP_UART_MODULE)) return 0;
+#endif
+
+    /* disable interrupt */
+    cli();
+
+    /* initialize variables of the module */
+    fep->intensity = 0;
+    fep->rxHead = 0;
+    fep->rxTail = 0;
+    fep->rxOverflow = 0;
+    fep->rxAccounted = 0;
+    FEP_RX_UNHOLD(fep);
+    fep->rx.state = FEP_RX_HEAD;
+    fep->rx.pos = 0;
+    fep->response = FEP_NO_RESPONSE;
+    fep->replyHead = 0;
+    fep->replyTail = 0;
+    for (i = 0; i < FEP_TX_PRIORITIES; i++) {
+        fep->txHead[i] = 0;
+        fep->txTail[i] = 0;
+        fep->txLimit[i] = FEP_TX_QUEUE_DEPTH;
+        fep->txMaxAge[i] = 0;
+    }
+    fep->tx.state = FEP_TX_IDLE;
+    fep->tx.prio = 0;
+    fep->tx.timedOut = 0;
+    fep->tdma.role = FEP_TDMA_OFF;
+    fep->tx.relayed = 0;
+    fep->transmitterAddr = 0;
+    fep->seqOn = 0;
+    fep->txSeq = 0;
+    memset(fep->seqFrom, 0, sizeof(fep->seqFrom));
+    memset(fep->seqWin, 0, sizeof(fep->seqWin));
+    memset(fep->peer, 0, sizeof(fep->peer));
+    memset(fep->handler, 0, sizeof(fep->handler));
+    fep->dispatching = 0;
+    fep->transport = transport;
+    fep->baud = FEP_BAUD;
+    memset(&fep->cfg, 0, sizeof(fep->cfg));
+#if defined( FEP_STATS )
+    memset(&fep->stats, 0, sizeof(fep->stats));
+#endif
+#if !defined( FEP_HOST )
+    fdev_setup_stream(&fep->stream, FEP_io_putchar, FEP_io_getchar, _FDEV_SETUP_RW);
+    fdev_set_udata(&fep->stream, fep);
+#endif
+
+    /* Initialize serial port */
+    (*transport->init)(transport->ctx, fep->baud);
+
+    /* Set additional rx interrupt handler */
+    (*transport->setRxHandler)(transport->ctx, FEP_rxDecode, fep);
+
+    /* enable interrupt */
+    sei();
+
+    /* FEP answers as soon as it has started. It keeps its rate while MCU
+     * restarts, so try the other rates if it doesn't */
+    if (!FEP_waitReady(fep) && fep_detectBaud(fep) == 0) return 0;
+
+    for (i = FEP_BAUD_CODES; i-- > 0; ) {
+        baud = FEP_baudRates[i] * 100UL;
+        if (baud <= fep->baud) break;
+        if (baud > FEP_BAUD_MAX || !FEP_baudUsable(baud)) continue;
+        if (fep_setBaud(fep, baud) == FEP_P0) break;
+    }
+    return 1;
+}
+
+static uint8_t FEP_waitReady(fep_t *fep) {
+    uint16_t t;
+
+    for (t = 0; t < FEP_BOOT_TIMEOUT_MS; t += FEP_READY_POLL_MS) {
+        if (FEP_ping(fep, FEP_READY_POLL_MS)) return 1;
+    }
+    return 0;
+}
+
+#if !defined( FEP_NO_STR )
+uint8_t fep_puts(fep_t *fep, char *str, uint8_t addr) {
+    return FEP_send(fep, FEP_DT_STR, str, strlen(str), addr, 0);
+}
+#endif
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_putbin(fep_t *fep, char *ary, size_t len, uint8_t addr) {
+    return FEP_send(fep, FEP_DT_BIN, ary, len, addr, 0);
+}
+#endif
+
+#if !defined( FEP_NO_STR )
+uint8_t fep_putsTimeout(fep_t *fep, char *str, uint8_t addr, uint16_t timeout) {
+    return FEP_send(fep, FEP_DT_STR, str, strlen(str), addr, timeout);
+}
+#endif
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_putbinTimeout(fep_t *fep, char *ary, size_t len, uint8_t addr, uint16_t timeout) {
+    return FEP_send(fep, FEP_DT_BIN, ary, len, addr, timeout);
+}
+#endif
+
+#if !defined( FEP_NO_STR )
+uint8_t fep_putsVia(fep_t *fep, char *str, uint8_t addr, const fep_route_t *route) {
+    return FEP_sendVia(fep, FEP_DT_STR, str, strlen(str), addr, route, FEP_RETRY, 0);
+}
+#endif
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_putbinVia(fep_t *fep, char *ary, size_t len, uint8_t addr, const fep_route_t *route) {
+    return FEP_sendVia(fep, FEP_DT_BIN, ary, len, addr, route, FEP_RETRY, 0);
+}
+#endif
+
+uint8_t fep_setRoute(fep_t *fep, uint8_t addr, const fep_route_t *route) {
+    fep_peer_t *peer;
+
+    if (route == NULL || route->hops == 0) {
+        peer = FEP_peerFind(fep, addr);
+        if (peer != NULL) {
+            peer->known &= ~FEP_PEER_ROUTE;
+            peer->route.hops = 0;
+            peer->relay = 0;
+        }
+        return FEP_P0;
+    }
+    if (route->hops > FEP_MAX_REPEATERS) return FEP_N0;
+
+    peer = FEP_peerGet(fep, addr);
+    peer->known |= FEP_PEER_ROUTE;
+    peer->route = *route;
+    peer->relay = 1;
+    peer->probe = 0;
+
+    return FEP_P0;
+}
+
+uint8_t fep_getRoute(fep_t *fep, uint8_t addr, fep_route_t *route) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+
+    route->hops = 0;
+    if (peer == NULL || peer->route.hops == 0) return 0;
+
+    if (peer->relay) *route = peer->route;
+    return 1;
+}
+
+static uint8_t FEP_send(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, uint16_t timeout) {
+    return FEP_sendVia(fep, type, data, len, addr, NULL, FEP_RETRY, timeout);
+}
+
+static uint8_t FEP_sendVia(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, const fep_route_t *route, uint8_t limit, uint16_t timeout) {
+    uint8_t response = FEP_NO_RESPONSE, previous, seq, i, tries = 0;
+    uint16_t total = 0, wait, t;
+    fep_route_t path;
+
+    if (len > FEP_maxDataLen(fep)) return FEP_N0;
+    if (route != NULL && route->hops > FEP_MAX_REPEATERS) return FEP_N0;
+
+    /* go ahead of the asynchronous packets */
+    FEP_txDrain(fep);
+
+    /* every try has the same number, so that the receiver can drop copies */
+    seq = FEP_nextSeq(fep);
+    for (i = 0; i < limit; i++) {
+        if (i > 0) {
+            /* wait randomly, so that the next try doesn't collide again */
+            wait = FEP_backoff(fep, i - 1);
+            if (timeout != 0 && total + wait >= timeout) break;
+            FEP_sleepMs(wait);
+            total += wait;
+        }
+
+        if (route != NULL) {
+            path = *route;
+        } else {
+            FEP_routePick(fep, addr, i == 0, &path);
+        }
+
+        /* hold the try until it fits in the own TDMA slot */
+        while ((wait = FEP_tdmaWait(fep, len, path.hops)) > 0) {
+            if (timeout != 0 && total + wait >= timeout) break;
+            FEP_sleepMs(wait);
+            total += wait;
+        }
+        if (wait > 0) break;
+
+        wait = FEP_rttTimeout(fep, addr, len, path.hops, i);
+        if (timeout != 0 && wait > timeout - total) wait = timeout - total;
+
+        FEP_sendPacket(fep, type, data, len, addr, &path, seq);
+        if (tries++ > 0) FEP_STAT_INC(fep, retries);
+
+        previous = response;
+        response = FEP_waitResponse(fep, wait, &t);
+        total += t;
+        if (response == FEP_NO_RESPONSE) FEP_STAT_INC(fep, timeouts);
+        if (path.hops == 0) {
+            /* only the direct link is measured */
+            FEP_peerResult(fep, addr, response);
+            if (response == FEP_P0) FEP_rttUpdate(fep, addr, len, t);
+        }
+        if (route == NULL) FEP_routeResult(fep, addr, path.hops > 0, response);
+        if (response == FEP_P0) break;
+        /* the command is wrong and trying again doesn't help, unless FEP
+         * was still sending the previous try which timed out */
+        if (response == FEP_N0 && previous != FEP_NO_RESPONSE) break;
+        if (timeout != 0 && total >= timeout) break;
+    }
+    FEP_STAT_TRIES(fep, tries);
+
+    _delay_us(100);
+
+    return response;
+}
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_sendBulk(fep_t *fep, const char *data, uint16_t len, uint8_t addr) {
+    char packet[FEP_MAX_PAYLOAD];
+    uint8_t acked[(FEP_BULK_MAX_FRAGS + 7) / 8];
+    uint8_t sent[(FEP_BULK_MAX_FRAGS + 7) / 8];   /* P0, or acked */
+    uint8_t window[FEP_BULK_WINDOW];
+    uint8_t response = FEP_P0, count, index, i, n, missing, lost = 0, failures = 0;
+    uint16_t offset, size;
+
+    if (len == 0 || len > FEP_BULK_MAX_LEN) return FEP_N0;
+
+    count = (len + FEP_BULK_FRAG_LEN - 1) / FEP_BULK_FRAG_LEN;
+    missing = count;
+    memset(acked, 0, sizeof(acked));
+    memset(sent, 0, sizeof(sent));
+
+    packet[0] = FEP_BULK_MAGIC;
+    packet[2] = ++fep->bulkId;
+    packet[4] = count;
+
+    while (failures < FEP_RETRY) {
+        /* a window of the fragments which haven't been sent */
+        for (index = 0, n = 0; index < count && n < FEP_BULK_WINDOW; index++) {
+            if (!(sent[index >> 3] & (1 << (index & 7)))) window[n++] = index;
+        }
+        if (n == 0) {
+            /* all sent but the answer is lost: the last missing one asks again */
+            for (index = count - 1; acked[index >> 3] & (1 << (index & 7)); index--);
+            window[n++] = index;
+        }
+
+        /* one try for each fragment. The failed ones are sent in the next
+         * window instead of holding up the others */
+        for (i = 0; i < n; i++) {
+            index = window[i];
+            offset = (uint16_t)index * FEP_BULK_FRAG_LEN;
+            size = (len - offset < FEP_BULK_FRAG_LEN) ? len - offset : FEP_BULK_FRAG_LEN;
+            packet[1] = (i == n - 1) ? FEP_BULK_LAST : FEP_BULK_DATA;
+            packet[3] = index;
+            memcpy(packet + FEP_BULK_HEAD_LEN, data + offset, size);
+
+            response = FEP_sendVia(fep, FEP_DT_BIN, packet, FEP_BULK_HEAD_LEN + size, addr, NULL, 1, 0);
+            if (response == FEP_P0) {
+                sent[index >> 3] |= 1 << (index & 7);
+                lost = 0;
+                continue;
+            }
+            /* the receiver is gone, or the command is wrong */
+            if (++lost >= FEP_RETRY || (response == FEP_N0 && lost == 1)) return response;
+            FEP_sleepMs(FEP_backoff(fep, lost - 1));
+        }
+
+        /* the receiver answers the last fragment of the window */
+        if (response == FEP_P0 && FEP_bulkWaitAck(fep, addr, packet[2], count, acked) == FEP_P0) {
+            /* the fragments sent but not arrived are sent again */
+            memcpy(sent, acked, sizeof(sent));
+        } else {
+            /* the answer to a fragment whose P0 was lost may be there */
+            FEP_bulkTakeAck(fep, addr, packet[2], count, acked);
+            for (i = 0; i < sizeof(sent); i++) sent[i] |= acked[i];
+        }
+
+        n = FEP_bulkMissing(acked, count);
+        if (n == 0) return FEP_P0;
+
+        /* count only the windows which didn't make progress */
+        failures = (n < missing) ? 0 : failures + 1;
+        missing = n;
+    }
+
+    return (response == FEP_P0) ? FEP_NO_RESPONSE : response;
+}
+
+void fep_bulkInit(fep_bulk_t *bulk, char *buf, uint16_t size) {
+    memset(bulk, 0, sizeof(*bulk));
+    bulk->buf = buf;
+    bulk->size = size;
+    bulk->state = FEP_BULK_MORE;
+}
+
+uint8_t fep_bulkFeed(fep_t *fep, fep_bulk_t *bulk, const fep_frame_t *frame) {
+    const uint8_t *d = (const uint8_t *)frame->data;
+    char packet[FEP_BULK_HEAD_LEN + sizeof(bulk->received)];
+    uint8_t index, count;
+    uint16_t offset, len;
+
+    if (frame->type != FEP_DT_BIN || frame->len < FEP_BULK_HEAD_LEN ||
+        d[0] != FEP_BULK_MAGIC ||
+        (d[1] != FEP_BULK_DATA && d[1] != FEP_BULK_LAST))
+    {
+        return FEP_BULK_NONE;
+    }
+    index = d[3];
+    count = d[4];
+    if (count == 0) return bulk->state;
+
+    if (bulk->count == 0 || bulk->addr != frame->addr || bulk->id != d[2] || bulk->count != count) {
+        /* a new transfer */
+        bulk->addr = frame->addr;
+        bulk->id = d[2];
+        bulk->count = count;
+        bulk->len = 0;
+        bulk->state = FEP_BULK_MORE;
+        memset(bulk->received, 0, sizeof(bulk->received));
+    }
+
+    len = frame->len - FEP_BULK_HEAD_LEN;
+    offset = (uint16_t)index * FEP_BULK_FRAG_LEN;
+    /* only the last fragment can be short */
+    if (index < count && len <= FEP_BULK_FRAG_LEN &&
+        (index == count - 1 || len == FEP_BULK_FRAG_LEN))
+    {
+        if (offset + len > bulk->size) {
+            bulk->state = FEP_BULK_ERROR;
+            return bulk->state;
+        }
+
+        memcpy(bulk->buf + offset, d + FEP_BULK_HEAD_LEN, len);
+        bulk->received[index >> 3] |= 1 << (index & 7);
+        if (index == count - 1) bulk->len = offset + len;
+    }
+    if (d[1] == FEP_BULK_DATA) return bulk->state;
+
+    /* FEP_BULK_LAST: answer which fragments have arrived */
+    if (bulk->state == FEP_BULK_ERROR) return bulk->state;
+    memcpy(packet, d, FEP_BULK_HEAD_LEN);
+    packet[1] = FEP_BULK_ACK;
+    memcpy(packet + FEP_BULK_HEAD_LEN, bulk->received, (count + 7) / 8);
+    FEP_send(fep, FEP_DT_BIN, packet, FEP_BULK_HEAD_LEN + (count + 7) / 8, frame->addr, 0);
+
+    if (FEP_bulkMissing(bulk->received, count) == 0) bulk->state = FEP_BULK_DONE;
+    return bulk->state;
+}
+
+uint8_t fep_recvBulk(fep_t *fep, fep_bulk_t *bulk, uint16_t timeout) {
+    const fep_frame_t *frame;
+    uint16_t start = FEP_millis();
+    uint8_t state;
+
+    while ((uint16_t)(FEP_millis() - start) < timeout) {
+        if (fep_recvFrame(fep, &frame) == FEP_DT_ERR) {
+            FEP_idle();
+            continue;
+        }
+
+        state = fep_bulkFeed(fep, bulk, frame);
+        fep_releaseFrame(fep);
+        if (state == FEP_BULK_DONE || state == FEP_BULK_ERROR) return state;
+        /* wait timeout from the last fragment */
+        if (state != FEP_BULK_NONE) start = FEP_millis();
+    }
+
+    return FEP_BULK_MORE;
+}
+
+static uint8_t FEP_bulkWaitAck(fep_t *fep, uint8_t addr, uint8_t id, uint8_t count, uint8_t *acked) {
+    fep_route_t path;
+    uint16_t start, timeout;
+
+    /* the receiver sends the answer as a packet, on the path of the query */
+    FEP_routePick(fep, addr, 0, &path);
+    timeout = 2 * FEP_rttTimeout(fep, addr, FEP_BULK_HEAD_LEN + (count + 7) / 8, path.hops, 0);
+
+    for (start = FEP_millis(); (uint16_t)(FEP_millis() - start) < timeout; FEP_idle()) {
+        if (FEP_bulkTakeAck(fep, addr, id, count, acked)) return FEP_P0;
+    }
+
+    return FEP_NO_RESPONSE;
+}
+
+static uint8_t FEP_bulkTakeAck(fep_t *fep, uint8_t addr, uint8_t id, uint8_t count, uint8_t *acked) {
+    volatile fep_frame_t *frame;
+    uint8_t pos, head, i, found = 0;
+#if defined( FEP_RX_DROP_OLDEST )
+    uint8_t held = fep->rxHeld;
+
+    fep->rxHeld = 1;
+#endif
+
+    /* the reader owns the frames between the tail and the head, so the
+     * answers are marked as taken there and skipped by fep_recvFrame() */
+    head = fep->rxHead;
+    for (pos = fep->rxTail; pos != head; pos++) {
+        frame = &fep->rxQueue[pos & FEP_RX_QUEUE_MASK];
+        if (frame->type != FEP_DT_BIN || frame->addr != addr ||
+            frame->len < FEP_BULK_HEAD_LEN + (count + 7) / 8 ||
+            (uint8_t)frame->data[0] != FEP_BULK_MAGIC || frame->data[1] != FEP_BULK_ACK ||
+            (uint8_t)frame->data[2] != id || (uint8_t)frame->data[4] != count)
+        {
+            continue;
+        }
+
+        for (i = 0; i < (count + 7) / 8; i++) {
+            acked[i] |= frame->data[FEP_BULK_HEAD_LEN + i];
+        }
+        frame->type = FEP_DT_ERR;
+        found = 1;
+    }
+#if defined( FEP_RX_DROP_OLDEST )
+    fep->rxHeld = held;
+#endif
+
+    return found;
+}
+
+static uint8_t FEP_bulkMissing(const uint8_t *bitmap, uint8_t count) {
+    uint8_t i, missing = 0;
+
+    for (i = 0; i < count; i++) {
+        if (!(bitmap[i >> 3] & (1 << (i & 7)))) missing++;
+    }
+    return missing;
+}
+
+void fep_batchInit(fep_batch_t *batch, uint16_t delay) {
+    batch->addr = 0;
+    batch->count = 0;
+    batch->len = 0;
+    batch->delay = delay;
+    batch->since = 0;
+}
+
+uint8_t fep_batchPut(fep_t *fep, fep_batch_t *batch, const char *msg, uint8_t len, uint8_t addr) {
+    uint8_t response;
+
+    if (1 + 1 + len > FEP_maxDataLen(fep)) return FEP_N0;
+    /* the delay is measured between calls */
+    if (batch->delay != 0 && !FEP_ticking) return FEP_N0;
+
+    /* send the messages before if this one can't join them */
+    if (batch->count > 0 &&
+        (batch->addr != addr || batch->len + 1 + len > FEP_maxDataLen(fep) ||
+         (batch->delay != 0 && FEP_millis() - batch->since >= batch->delay)))
+    {
+        response = fep_batchFlush(fep, batch);
+        if (response != FEP_P0) return response;
+    }
+
+    if (batch->count == 0) {
+        batch->addr = addr;
+        batch->buf[0] = FEP_BATCH_MAGIC;
+        batch->len = 1;
+        batch->since = FEP_millis();
+    }
+    batch->buf[batch->len++] = len;
+    memcpy(batch->buf + batch->len, msg, len);
+    batch->len += len;
+    batch->count++;
+
+    return FEP_P1;
+}
+
+uint8_t fep_batchFlush(fep_t *fep, fep_batch_t *batch) {
+    uint8_t response;
+
+    if (batch->count == 0) return FEP_P0;
+
+    response = FEP_send(fep, FEP_DT_BIN, batch->buf, batch->len, batch->addr, 0);
+    batch->count = 0;
+    batch->len = 0;
+
+    return response;
+}
+
+uint8_t fep_batchPoll(fep_t *fep, fep_batch_t *batch) {
+    if (batch->count == 0 || batch->delay == 0 || FEP_millis() - batch->since < batch->delay) return FEP_P1;
+
+    return fep_batchFlush(fep, batch);
+}
+
+uint8_t fep_batchNext(const fep_frame_t *frame, uint16_t *pos, const char **msg, uint8_t *len) {
+    uint16_t p = *pos;
+
+    if (p == 0) {
+        if (frame->type != FEP_DT_BIN || frame->len < 1 || (uint8_t)frame->data[0] != FEP_BATCH_MAGIC) {
+            return 0;
+        }
+        p = 1;
+    }
+    /* a broken length ends the batch */
+    if (p >= frame->len || p + 1 + (uint8_t)frame->data[p] > frame->len) {
+        *pos = frame->len;
+        return 0;
+    }
+
+    *len = frame->data[p];
+    *msg = frame->data + p + 1;
+    *pos = p + 1 + *len;
+
+    return 1;
+}
+
+void fep_pipeOpen(fep_t *fep, fep_pipe_t *pipe, uint8_t addr) {
+#if defined( FEP_HOST )
+    cookie_io_functions_t out = { NULL, FEP_pipeWrite, NULL, NULL };
+    cookie_io_functions_t in = { FEP_pipeRead, NULL, NULL, NULL };
+#endif
+
+    pipe->fep = fep;
+    pipe->addr = addr;
+    pipe->response = FEP_P0;
+    pipe->len = 0;
+    pipe->pos = 0;
+#if defined( FEP_HOST )
+    /* stdio buffers the packet in buf and writes it when it is full, at
+     * a newline and at fflush() */
+    if (pipe->out == NULL) pipe->out = fopencookie(pipe, "w", out);
+    if (pipe->in == NULL) pipe->in = fopencookie(pipe, "r", in);
+    setvbuf(pipe->out, pipe->buf, _IOLBF, sizeof(pipe->buf));
+    setvbuf(pipe->in, NULL, _IONBF, 0);
+#else
+    fdev_setup_stream(&pipe->out, FEP_pipePutc, NULL, _FDEV_SETUP_WRITE);
+    fdev_set_udata(&pipe->out, pipe);
+    fdev_setup_stream(&pipe->in, NULL, FEP_pipeGetc, _FDEV_SETUP_READ);
+    fdev_set_udata(&pipe->in, pipe);
+#endif
+}
+
+FILE *fep_pipeOut(fep_pipe_t *pipe) {
+#if defined( FEP_HOST )
+    return pipe->out;
+#else
+    return &pipe->out;
+#endif
+}
+
+FILE *fep_pipeIn(fep_pipe_t *pipe) {
+#if defined( FEP_HOST )
+    return pipe->in;
+#else
+    return &pipe->in;
+#endif
+}
+
+uint8_t fep_pipeFlush(fep_pipe_t *pipe) {
+    pipe->response = FEP_P0;
+#if defined( FEP_HOST )
+    fflush(pipe->out);
+#else
+    if (pipe->len > 0) FEP_pipeSend(pipe, pipe->buf, pipe->len);
+#endif
+    return pipe->response;
+}
+
+static uint8_t FEP_pipeSend(fep_pipe_t *pipe, const char *data, uint16_t len) {
+    pipe->response = FEP_send(pipe->fep, FEP_DT_BIN, data, len, pipe->addr, 0);
+    /* an undelivered packet is dropped, not sent again with the next one */
+    pipe->len = 0;
+    return pipe->response;
+}
+
+static int FEP_pipeGet(fep_pipe_t *pipe) {
+    const fep_frame_t *frame;
+    uint8_t type;
+
+    for (;;) {
+        type = fep_recvFrame(pipe->fep, &frame);
+        if (type == FEP_DT_ERR) return -1;
+        if (type != FEP_DT_LINE) {
+            /* leave the packets from other modems to the application */
+            if (pipe->addr != FEP_BROADCAST && frame->addr != pipe->addr) {
+                FEP_RX_UNHOLD(pipe->fep);
+                return -1;
+            }
+            if (pipe->pos < frame->len) return (uint8_t)frame->data[pipe->pos++];
+        }
+        fep_releaseFrame(pipe->fep);
+        pipe->pos = 0;
+    }
+}
+
+#if defined( FEP_HOST )
+static ssize_t FEP_pipeWrite(void *cookie, const char *buf, size_t size) {
+    fep_pipe_t *pipe = cookie;
+    size_t done, n;
+
+    for (done = 0; done < size; done += n) {
+        n = size - done;
+        if (n > FEP_maxDataLen(pipe->fep)) n = FEP_maxDataLen(pipe->fep);
+        if (FEP_pipeSend(pipe, buf + done, n) != FEP_P0) return -1;
+    }
+    return size;
+}
+
+static ssize_t FEP_pipeRead(void *cookie, char *buf, size_t size) {
+    size_t n = 0;
+    int c;
+
+    while (n < size && (c = FEP_pipeGet(cookie)) >= 0) {
+        buf[n++] = c;
+    }
+    return n;
+}
+#else
+static int FEP_pipePutc(char c, FILE *stream) {
+    fep_pipe_t *pipe = fdev_get_udata(stream);
+
+    pipe->buf[pipe->len++] = c;
+    if (c == '\n' || pipe->len >= FEP_maxDataLen(pipe->fep)) {
+        if (FEP_pipeSend(pipe, pipe->buf, pipe->len) != FEP_P0) return _FDEV_ERR;
+    }
+    return 0;
+}
+
+static int FEP_pipeGetc(FILE *stream) {
+    int c = FEP_pipeGet(fdev_get_udata(stream));
+
+    return (c < 0) ? _FDEV_EOF : c;
+}
+#endif
+#endif
+
+#if !defined( FEP_NO_STR )
+uint8_t fep_putsAsync(fep_t *fep, const char *str, uint8_t addr, fep_callback_t cb, void *arg) {
+    return FEP_txEnqueue(fep, FEP_DT_STR, str, strlen(str), addr, FEP_PRIO_NORMAL, cb, arg);
+}
+#endif
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_putbinAsync(fep_t *fep, const char *ary, size_t len, uint8_t addr, fep_callback_t cb, void *arg) {
+    return FEP_txEnqueue(fep, FEP_DT_BIN, ary, len, addr, FEP_PRIO_NORMAL, cb, arg);
+}
+#endif
+
+#if !defined( FEP_NO_STR )
+uint8_t fep_putsAsyncPrio(fep_t *fep, const char *str, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg) {
+    return FEP_txEnqueue(fep, FEP_DT_STR, str, strlen(str), addr, prio, cb, arg);
+}
+#endif
+
+#if !defined( FEP_NO_BIN )
+uint8_t fep_putbinAsyncPrio(fep_t *fep, const char *ary, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg) {
+    return FEP_txEnqueue(fep, FEP_DT_BIN, ary, len, addr, prio, cb, arg);
+}
+#endif
+
+uint8_t fep_setTxQueue(fep_t *fep, uint8_t prio, uint8_t depth, uint16_t maxAge) {
+    if (prio >= FEP_TX_PRIORITIES || depth == 0 || depth > FEP_TX_QUEUE_DEPTH) return FEP_N0;
+
+    fep->txLimit[prio] = depth;
+    fep->txMaxAge[prio] = maxAge;
+
+    return FEP_P0;
+}
+
+static uint8_t FEP_txEnqueue(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg) {
+    fep_txpacket_t *packet;
+
+    /* fep_poll() measures the timeouts between calls */
+    if (!FEP_ticking) return FEP_N0;
+    if (len > FEP_maxDataLen(fep) || prio >= FEP_TX_PRIORITIES) return FEP_N0;
+    if ((uint8_t)(fep->txHead[prio] - fep->txTail[prio]) >= fep->txLimit[prio]) return FEP_N3;
+
+    packet = &fep->txQueue[prio][fep->txHead[prio] & FEP_TX_QUEUE_MASK];
+    packet->type = type;
+    packet->data = data;
+    packet->len = len;
+    packet->addr = addr;
+    packet->seq = FEP_nextSeq(fep);
+    packet->retry = 0;
+    packet->queuedAt = FEP_millis();
+    packet->cb = cb;
+    packet->arg = arg;
+    fep->txHead[prio]++;
+
+    return FEP_P1;
+}
+
+static uint8_t FEP_txNext(fep_t *fep, uint32_t now) {
+    fep_txpacket_t *packet;
+    uint8_t prio;
+
+    for (prio = 0; prio < FEP_TX_PRIORITIES; prio++) {
+        while (fep->txHead[prio] != fep->txTail[prio]) {
+            packet = &fep->txQueue[prio][fep->txTail[prio] & FEP_TX_QUEUE_MASK];
+            if (fep->txMaxAge[prio] == 0 || now - packet->queuedAt <= fep->txMaxAge[prio]) {
+                return prio;
+            }
+            /* stale. the slot can be reused by the callback */
+            FEP_STAT_INC(fep, txStale);
+            fep->txTail[prio]++;
+            if (packet->cb != NULL) (*packet->cb)(FEP_DROPPED, packet->arg);
+        }
+    }
+
+    return FEP_TX_PRIORITIES;
+}
+
+void fep_poll(fep_t *fep) {
+    FEP_txPoll(fep);
+    FEP_dispatch(fep);
+}
+
+static void FEP_txDrain(fep_t *fep) {
+    while (fep->tx.state == FEP_TX_WAIT || fep->tx.state == FEP_TX_BEACON) {
+        FEP_txPoll(fep);
+        if (fep->tx.state == FEP_TX_WAIT || fep->tx.state == FEP_TX_BEACON) FEP_idle();
+    }
+}
+
+static void FEP_txPoll(fep_t *fep) {
+    fep_txpacket_t *packet;
+    fep_route_t path;
+    uint8_t response, prio;
+    uint16_t wait;
+    uint32_t now;
+
+    now = FEP_millis();
+
+    if (fep->tx.state == FEP_TX_BACKOFF) {
+        /* between tries: a packet of a higher priority goes first, and
+         * this one is tried again after it */
+        prio = FEP_txNext(fep, now);
+        if (prio >= fep->tx.prio && (int32_t)(now - fep->tx.deadline) < 0) {
+            /* the TDMA beacon goes between tries, too */
+            FEP_tdmaBeacon(fep, now);
+            return;
+        }
+        fep->tx.state = FEP_TX_IDLE;
+    }
+
+    if (fep->tx.state == FEP_TX_BEACON) {
+        /* the frame starts when the beacon has been sent */
+        response = FEP_takeResponse(fep);
+        if (response == FEP_P1) return;
+        if (response == FEP_NO_RESPONSE && (int32_t)(now - fep->tx.deadline) < 0) return;
+        fep->tdma.beaconAt = now;
+        fep->tx.state = FEP_TX_IDLE;
+    }
+
+    if (fep->tx.state == FEP_TX_IDLE) {
+        if (FEP_tdmaBeacon(fep, now)) return;
+
+        /* send the packet at the tail of the highest priority */
+        prio = FEP_txNext(fep, now);
+        if (prio >= FEP_TX_PRIORITIES) return;
+        packet = &fep->txQueue[prio][fep->txTail[prio] & FEP_TX_QUEUE_MASK];
+        /* hold it until the own TDMA slot (the longest path, without
+         * counting a probe of the direct link) */
+        FEP_routePick(fep, packet->addr, 0, &path);
+        wait = FEP_tdmaWait(fep, packet->len, path.hops);
+        if (wait > 0) {
+            fep->tx.prio = prio;
+            fep->tx.deadline = now + wait;
+            fep->tx.state = FEP_TX_BACKOFF;
+            return;
+        }
+        FEP_routePick(fep, packet->addr, packet->retry == 0, &path);
+        FEP_sendPacket(fep, packet->type, packet->data, packet->len, packet->addr, &path, packet->seq);
+        if (packet->retry > 0) FEP_STAT_INC(fep, retries);
+        fep->tx.prio = prio;
+        fep->tx.relayed = (path.hops > 0);
+        fep->tx.sentAt = now;
+        fep->tx.deadline = now + FEP_rttTimeout(fep, packet->addr, packet->len, path.hops, packet->retry);
+        fep->tx.state = FEP_TX_WAIT;
+        return;
+    }
+
+    /* FEP_TX_WAIT */
+    packet = &fep->txQueue[fep->tx.prio][fep->txTail[fep->tx.prio] & FEP_TX_QUEUE_MASK];
+    response = FEP_takeResponse(fep);
+    if (response == FEP_P1) {
+        /* command accepted, wait for the result of sending */
+        return;
+    }
+    if (response == FEP_NO_RESPONSE) {
+        if ((int32_t)(now - fep->tx.deadline) < 0) return;
+        FEP_STAT_INC(fep, timeouts);
+    }
+    if (!fep->tx.relayed) {
+        FEP_peerResult(fep, packet->addr, response);
+        if (response == FEP_P0) FEP_rttUpdate(fep, packet->addr, packet->len, now - fep->tx.sentAt);
+    }
+    FEP_routeResult(fep, packet->addr, fep->tx.relayed, response);
+
+    if (response != FEP_P0 && (response != FEP_N0 || fep->tx.timedOut) && ++packet->retry < FEP_RETRY) {
+        /* N0 after a timeout: FEP was still sending the previous try */
+        fep->tx.timedOut = (response == FEP_NO_RESPONSE);
+        /* send again after the backoff */
+        fep->tx.deadline = now + FEP_backoff(fep, packet->retry - 1);
+        fep->tx.state = FEP_TX_BACKOFF;
+        return;
+    }
+
+    /* finished. the slot can be reused by the callback */
+    FEP_STAT_TRIES(fep, (packet->retry < FEP_RETRY) ? packet->retry + 1 : FEP_RETRY);
+    fep->tx.state = FEP_TX_IDLE;
+    fep->tx.timedOut = 0;
+    fep->txTail[fep->tx.prio]++;
+    if (packet->cb != NULL) (*packet->cb)(response, packet->arg);
+}
+
+uint8_t fep_txPending(fep_t *fep) {
+    uint8_t prio, n = 0;
+
+    for (prio = 0; prio < FEP_TX_PRIORITIES; prio++) {
+        n += (uint8_t)(fep->txHead[prio] - fep->txTail[prio]);
+    }
+
+    return n;
+}
+
+uint8_t fep_onReceive(fep_t *fep, int16_t addr, uint8_t type, fep_handler_t handler, void *arg) {
+    fep_dispatch_t *entry, *unused = NULL;
+    uint8_t i;
+
+    if (addr < FEP_ANY_ADDR || addr > 255) return FEP_N0;
+    if (type == FEP_DT_ERR || type > FEP_DT_ANY) return FEP_N0;
+
+    for (i = 0; i < FEP_HANDLERS; i++) {
+        entry = &fep->handler[i];
+        if (entry->fn != NULL && entry->addr == addr && entry->type == type) {
+            /* replace or remove the handler */
+            entry->fn = handler;
+            entry->arg = arg;
+            return FEP_P0;
+        }
+        if (entry->fn == NULL && unused == NULL) unused = entry;
+    }
+    if (handler == NULL) return FEP_P0;
+    if (unused == NULL) return FEP_N3;
+
+    unused->fn = handler;
+    unused->arg = arg;
+    unused->addr = addr;
+    unused->type = type;
+    return FEP_P0;
+}
+
+static void FEP_dispatch(fep_t *fep) {
+    const fep_frame_t *frame;
+    fep_dispatch_t *entry;
+    uint8_t type, pos;
+
+    /* a handler calling fep_poll() must not get its own frame again */
+    if (fep->dispatching) return;
+    fep->dispatching = 1;
+
+    while ((type = fep_recvFrame(fep, &frame)) != FEP_DT_ERR) {
+        entry = FEP_handlerFind(fep, frame->addr, type);
+        if (entry == NULL && type != FEP_DT_LINE) break;
+        if (entry != NULL) (*entry->fn)(frame, entry->arg);
+        fep_releaseFrame(fep);
+    }
+
+    if (type != FEP_DT_ERR) {
+        /* the frame at the tail is left for fep_gets(). The frames behind
+         * it are passed in place and marked as taken, like the answers
+         * of fep_sendBulk() (still held by fep_recvFrame()) */
+        for (pos = fep->rxTail + 1; pos != fep->rxHead; pos++) {
+            frame = (const fep_frame_t *)&fep->rxQueue[pos & FEP_RX_QUEUE_MASK];
+            type = frame->type;
+            if (type == FEP_DT_ERR) continue;
+            entry = FEP_handlerFind(fep, frame->addr, type);
+            if (entry == NULL && type != FEP_DT_LINE) continue;
+            if (type != FEP_DT_LINE) {
+                fep->transmitterAddr = frame->addr;
+                fep->intensity = frame->intensity;
+                FEP_peerReceived(fep, frame);
+            }
+            if (entry != NULL) (*entry->fn)(frame, entry->arg);
+            fep->rxQueue[pos & FEP_RX_QUEUE_MASK].type = FEP_DT_ERR;
+        }
+        FEP_RX_UNHOLD(fep);
+    }
+
+    fep->dispatching = 0;
+}
+
+static fep_dispatch_t *FEP_handlerFind(fep_t *fep, uint8_t addr, uint8_t type) {
+    fep_dispatch_t *entry, *found = NULL;
+    uint8_t i, score, best = 0;
+
+    for (i = 0; i < FEP_HANDLERS; i++) {
+        entry = &fep->handler[i];
+        if (entry->fn == NULL) continue;
+        /* lines have no transmitter, and FEP_DT_ANY is any packet */
+        if (entry->addr != FEP_ANY_ADDR && (type == FEP_DT_LINE || entry->addr != addr)) continue;
+        if (entry->type != type && (entry->type != FEP_DT_ANY || type == FEP_DT_LINE)) continue;
+
+        score = 1 + (entry->addr != FEP_ANY_ADDR) * 2 + (entry->type != FEP_DT_ANY);
+        if (score > best) {
+            best = score;
+            found = entry;
+        }
+    }
+
+    return found;
+}
+
+uint8_t fep_tdmaStart(fep_t *fep, uint8_t slots, uint16_t slotMs, uint8_t slot) {
+    if (slots == 0 || slot >= slots || slotMs == 0 || !FEP_ticking) return FEP_N0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        fep->tdma.slots = slots;
+        fep->tdma.slotMs = slotMs;
+    }
+    fep->tdma.slot = slot;
+    fep->tdma.role = FEP_TDMA_COORDINATOR;
+    /* the first frame starts at the next fep_poll() */
+    fep->tdma.beaconAt = FEP_millis() - (uint32_t)slots * slotMs;
+
+    return FEP_P0;
+}
+
+uint8_t fep_tdmaJoin(fep_t *fep, uint8_t slot) {
+    /* the slots are timed from the beacon */
+    if (!FEP_ticking) return FEP_N0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        fep->tdma.slots = 0;
+        fep->tdma.slot = slot;
+        fep->tdma.role = FEP_TDMA_NODE;
+        /* the time of joining until the first beacon */
+        fep->tdma.beaconAt = FEP_ms;
+    }
+
+    return FEP_P0;
+}
+
+void fep_tdmaStop(fep_t *fep) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        fep->tdma.role = FEP_TDMA_OFF;
+    }
+}
+
+static uint16_t FEP_tdmaWait(fep_t *fep, size_t len, uint8_t hops) {
+    uint32_t beaconAt, frame, pos, start, room, need;
+    uint16_t slotMs;
+    uint8_t slots;
+
+    if (fep->tdma.role == FEP_TDMA_OFF) return 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        slots = fep->tdma.slots;
+        slotMs = fep->tdma.slotMs;
+        beaconAt = fep->tdma.beaconAt;
+    }
+    if (slots == 0) {
+        /* a node listens for the first beacon for a while, so that the
+         * nodes joining together don't collide before it */
+        if (fep->tdma.role == FEP_TDMA_NODE && FEP_millis() - beaconAt < FEP_TDMA_JOIN_MS) return FEP_TDMA_LISTEN_MS;
+        return 0;
+    }
+    if (fep->tdma.slot >= slots) return 0;
+
+    /* a frame is the slots and the beacon before them */
+    frame = (uint32_t)slots * slotMs + FEP_wireTime(fep, FEP_TDMA_BEACON_LEN);
+    pos = FEP_millis() - beaconAt;
+    if (fep->tdma.role == FEP_TDMA_NODE) {
+        /* the beacon ended on air before its line came from FEP */
+        pos += ((uint32_t)(FEP_TDMA_BEACON_LEN + 14) * 10000) / fep->baud;
+        /* the coordinator is gone: send freely */
+        if (pos >= frame * FEP_TDMA_MAX_MISSED) return 0;
+    }
+    pos %= frame;
+
+    start = (uint32_t)fep->tdma.slot * slotMs;
+    room = (slotMs > FEP_TDMA_GUARD_MS) ? slotMs - FEP_TDMA_GUARD_MS : 0;
+    /* a try too long for the slot starts in its first half */
+    need = (uint32_t)FEP_wireTime(fep, len) * (hops + 1);
+    if (need > room / 2) need = room / 2;
+
+    if (pos >= start && pos + need <= start + room) return 0;
+    return (pos < start) ? start - pos : frame - pos + start;
+}
+
+static uint8_t FEP_tdmaBeacon(fep_t *fep, uint32_t now) {
+    char beacon[FEP_TDMA_BEACON_LEN];
+    fep_route_t direct = { 0 };
+
+    if (fep->tdma.role != FEP_TDMA_COORDINATOR) return 0;
+    if (now - fep->tdma.beaconAt < (uint32_t)fep->tdma.slots * fep->tdma.slotMs) return 0;
+
+    beacon[0] = FEP_TDMA_MAGIC;
+    beacon[1] = fep->tdma.slots;
+    beacon[2] = fep->tdma.slotMs >> 8;
+    beacon[3] = fep->tdma.slotMs & 0xFF;
+    FEP_sendPacket(fep, FEP_DT_BIN, beacon, FEP_TDMA_BEACON_LEN, FEP_BROADCAST, &direct, FEP_SEQ_NONE);
+    fep->tx.deadline = now + FEP_rttTimeout(fep, FEP_BROADCAST, FEP_TDMA_BEACON_LEN, 0, 0);
+    fep->tx.state = FEP_TX_BEACON;
+
+    return 1;
+}
+
+void FEP_tick(void) {
+    FEP_ms++;
+    FEP_ticking = 1;
+}
+
+uint8_t fep_gets(fep_t *fep, char *str, size_t len) {
+    const fep_frame_t *frame;
+    uint8_t data_mode;
+    size_t data_len;
+
+    /* skip over lines which are not packets */
+    while ((data_mode = fep_recvFrame(fep, &frame)) == FEP_DT_LINE) {
+        fep_releaseFrame(fep);
+    }
+    if (data_mode == FEP_DT_ERR) return FEP_DT_ERR;
+
+    data_len = frame->len;
+    if (data_mode == FEP_DT_STR) {
+        if (len == 0) {
+            /* no room even for null character */
+            fep_releaseFrame(fep);
+            return FEP_DT_ERR;
+        }
+        /* leave room for null character */
+        if (data_len > len - 1) data_len = len - 1;
+        str[data_len] = '\0';
+    } else if (data_len > len) {
+        /* received data is too long! */
+        fep_releaseFrame(fep);
+        return FEP_DT_ERR;
+    }
+    memcpy(str, frame->data, data_len);
+
+    fep_releaseFrame(fep);
+
+    return data_mode;
+}
+
+uint8_t fep_recvFrame(fep_t *fep, const fep_frame_t **out) {
+    const fep_frame_t *frame;
+
+    /* held until fep_releaseFrame() */
+    FEP_RX_HOLD(fep);
+
+    /* skip the frames taken by fep_sendBulk() */
+    while (fep_available(fep) && fep->rxQueue[fep->rxTail & FEP_RX_QUEUE_MASK].type == FEP_DT_ERR) {
+        fep->rxTail++;
+        fep->rxAccounted = 0;
+    }
+    if (!fep_available(fep)) {
+        FEP_RX_UNHOLD(fep);
+        return FEP_DT_ERR;
+    }
+
+    /* the slot at the tail belongs to the reader until rxTail is
+     * advanced, so it is not volatile while the caller holds it */
+    frame = (const fep_frame_t *)&fep->rxQueue[fep->rxTail & FEP_RX_QUEUE_MASK];
+    /* a frame left to the next reader is accounted once */
+    if (frame->type != FEP_DT_LINE && !fep->rxAccounted) {
+        fep->transmitterAddr = frame->addr;
+        fep->intensity = frame->intensity;
+        FEP_peerReceived(fep, frame);
+    }
+    fep->rxAccounted = 1;
+
+    *out = frame;
+    return frame->type;
+}
+
+void fep_releaseFrame(fep_t *fep) {
+    if (fep_available(fep)) fep->rxTail++;
+    fep->rxAccounted = 0;
+    FEP_RX_UNHOLD(fep);
+}
+
+uint8_t fep_getTransmitterAddr(fep_t *fep) {
+    return fep->transmitterAddr;
+}
+
+uint8_t fep_flushFEP(fep_t *fep) {
+    uint8_t response, i;
+
+    FEP_txDrain(fep);
+    for (i = 0; i < FEP_RETRY; i++) {
+        fprintf_P(fep_stream(fep), PSTR("@BCL\r\n"));
+
+        response = FEP_waitResponse(fep, FEP_CMD_TIMEOUT_MS, NULL);
+
+        if (response == FEP_P0) break;
+    }
+
+    return response;
+}
+
+uint8_t fep_getReg(fep_t *fep, uint8_t reg_num) {
+    if (reg_num >= FEP_REG_COUNT) return 0;
+
+    if (!(fep->cfg.regValid & ((uint32_t)1 << reg_num)) &&
+        FEP_readItem(fep, reg_num) != FEP_P0)
+    {
+        return 0;
+    }
+
+    return fep->cfg.reg[reg_num];
+}
+
+uint8_t fep_setReg(fep_t *fep, uint8_t reg_num, uint8_t val) {
+    uint32_t bit = (uint32_t)1 << reg_num;
+    uint8_t response;
+
+    if (reg_num >= FEP_REG_COUNT) return FEP_N0;
+
+    if (fep->cfg.open) {
+        fep->cfg.reg[reg_num] = val;
+        fep->cfg.regValid |= bit;
+        fep->cfg.regDirty |= bit;
+        return FEP_P0;
+    }
+
+    /* FEP already has the value */
+    if ((fep->cfg.regValid & bit) && fep->cfg.reg[reg_num] == val) return FEP_P0;
+
+    response = FEP_writeReg(fep, reg_num, val);
+
+    fep_reset(fep);
+    return response;
+}
+
+static uint8_t FEP_writeReg(fep_t *fep, uint8_t reg_num, uint8_t val) {
+    uint32_t bit = (uint32_t)1 << reg_num;
+    uint8_t response, i;
+
+    FEP_txDrain(fep);
+    for (i = 0; i < FEP_RETRY; i++) {
+        fprintf_P(fep_stream(fep), PSTR("@REG%02d:%03d\r\n"), reg_num, val);
+
+        response = FEP_waitResponse(fep, FEP_CMD_TIMEOUT_MS, NULL);
+
+        if (response == FEP_P0) break;
+    }
+
+    fep->cfg.regDirty &= ~bit;
+    if (response == FEP_P0) {
+        fep->cfg.reg[reg_num] = val;
+        fep->cfg.regValid |= bit;
+    } else {
+        /* the register may or may not be changed */
+        fep->cfg.regValid &= ~bit;
+    }
+
+    return response;
+}
+
+int16_t fep_getIntensity(fep_t *fep) {
+    return fep->intensity;
+}
+
+uint8_t fep_getLink(fep_t *fep, uint8_t addr, fep_link_t *link) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+
+    if (peer == NULL) return 0;
+
+    link->addr = addr;
+    link->intensity = (peer->known & FEP_PEER_RX) ? (peer->intensity + 4) >> 3 : -1;
+    link->delivery = (peer->known & FEP_PEER_TX) ? ((uint32_t)peer->delivery * 1000 + 32767) / 65535 : 0xFFFF;
+    link->rtt = (peer->known & FEP_PEER_RTT) ? peer->srtt >> 3 : 0;
+    link->age = (peer->known & FEP_PEER_RX) ? FEP_millis() - peer->seen : 0xFFFFFFFF;
+
+    return 1;
+}
+
+uint8_t fep_getLinks(fep_t *fep, fep_link_t *links, uint8_t max) {
+    uint8_t i, n = 0;
+
+    for (i = 0; i < FEP_PEER_TABLE_SIZE && n < max; i++) {
+        if (fep->peer[i].known == 0) continue;
+        if (fep_getLink(fep, fep->peer[i].addr, &links[n])) n++;
+    }
+
+    return n;
+}
+
+uint8_t fep_getMyAddr(fep_t *fep) {
+    return fep_getReg(fep, 0);
+}
+
+uint8_t fep_setMyAddr(fep_t *fep, uint8_t addr) {
+    return fep_setReg(fep, 0, addr);
+}
+
+void fep_getFrq(fep_t *fep, uint8_t *ch1, uint8_t *ch2, uint8_t *ch3) {
+    *ch1 = FEP_getFrq1(fep, 1);
+    *ch2 = FEP_getFrq1(fep, 2);
+    *ch3 = FEP_getFrq1(fep, 3);
+}
+
+static uint8_t FEP_getFrq1(fep_t *fep, uint8_t ch) {
+    if (!(fep->cfg.valid & FEP_CFG_FRQ(ch)) &&
+        FEP_readItem(fep, FEP_ITEM_FRQ + ch - 1) != FEP_P0)
+    {
+        return 0;
+    }
+
+    return fep->cfg.frq[ch - 1];
+}
+
+uint8_t fep_setFrq(fep_t *fep, uint8_t ch1, uint8_t ch2, uint8_t ch3) {
+    if (FEP_setFrq1(fep, 1, ch1) == FEP_N0) return FEP_N0;
+    if (FEP_setFrq1(fep, 2, ch2) == FEP_N0) return FEP_N0;
+    if (FEP_setFrq1(fep, 3, ch3) == FEP_N0) return FEP_N0;
+
+    return FEP_P0;
+}
+
+static uint8_t FEP_setFrq1(fep_t *fep, uint8_t ch, uint8_t band) {
+    if (fep->cfg.open) {
+        fep->cfg.frq[ch - 1] = band;
+        fep->cfg.valid |= FEP_CFG_FRQ(ch);
+        fep->cfg.dirty |= FEP_CFG_FRQ(ch);
+        return FEP_P0;
+    }
+
+    /* FEP already has the band */
+    if ((fep->cfg.valid & FEP_CFG_FRQ(ch)) && fep->cfg.frq[ch - 1] == band) return FEP_P0;
+
+    return FEP_writeFrq1(fep, ch, band);
+}
+
+static uint8_t FEP_writeFrq1(fep_t *fep, uint8_t ch, uint8_t band) {
+    uint8_t response, i;
+
+    FEP_txDrain(fep);
+    for (i = 0; i < FEP_RETRY; i++) {
+        fprintf_P(fep_stream(fep), PSTR("@FRQ%1d:%02d\r\n"), ch, band);
+
+        response = FEP_waitResponse(fep, FEP_CMD_TIMEOUT_MS, NULL);
+
+        if (response == FEP_P0) break;
+    }
+
+    fep->cfg.dirty &= ~FEP_CFG_FRQ(ch);
+    if (response == FEP_P0) {
+        fep->cfg.frq[ch - 1] = band;
+        fep->cfg.valid |= FEP_CFG_FRQ(ch);
+    } else {
+        fep->cfg.valid &= ~FEP_CFG_FRQ(ch);
+    }
+
+    return response;
+}
+
+uint16_t fep_getID(fep_t *fep) {
+    if (!(fep->cfg.valid & FEP_CFG_ID) && FEP_readItem(fep, FEP_ITEM_ID) != FEP_P0) {
+        return 0;
+    }
+
+    return fep->cfg.id;
+}
+
+uint8_t fep_setID(fep_t *fep, uint16_t id) {
+    if (fep->cfg.open) {
+        fep->cfg.id = id;
+        fep->cfg.valid |= FEP_CFG_ID;
+        fep->cfg.dirty |= FEP_CFG_ID;
+        return FEP_P0;
+    }
+
+    /* FEP already has the ID */
+    if ((fep->cfg.valid & FEP_CFG_ID) && fep->cfg.id == id) return FEP_P0;
+
+    return FEP_writeID(fep, id);
+}
+
+static uint8_t FEP_writeID(fep_t *fep, uint16_t id) {
+    uint8_t response, i;
+
+    FEP_txDrain(fep);
+    for (i = 0; i < FEP_RETRY; i++) {
+        fprintf_P(fep_stream(fep), PSTR("@IDW%4XH\r\n"), id);
+
+        response = FEP_waitResponse(fep, FEP_CMD_TIMEOUT_MS, NULL);
+
+        if (response == FEP_P0) break;
+    }
+
+    fep->cfg.dirty &= ~FEP_CFG_ID;
+    if (response == FEP_P0) {
+        fep->cfg.id = id;
+        fep->cfg.valid |= FEP_CFG_ID;
+    } else {
+        fep->cfg.valid &= ~FEP_CFG_ID;
+    }
+
+    return response;
+}
+
+uint8_t fep_reset(fep_t *fep) {
+    uint8_t response, i;
+
+    FEP_txDrain(fep);
+    for (i = 0; i < FEP_RETRY; i++) {
+        fprintf_P(fep_stream(fep), PSTR("@RST\r\n"));
+
+        response = FEP_waitResponse(fep, FEP_CMD_TIMEOUT_MS, NULL);
+
+        if (response == FEP_P0) break;
+    }
+
+    return response;
+}
+
+uint32_t fep_getBaud(fep_t *fep) {
+    return fep->baud;
+}
+
+uint8_t fep_setBaud(fep_t *fep, uint32_t baud) {
+    uint32_t old = fep->baud;
+    uint8_t code = FEP_baudCode(baud), response;
+
+    if (code >= FEP_BAUD_CODES || !FEP_baudUsable(baud)) return FEP_N0;
+    if (baud == old) return FEP_P0;
+
+    response = FEP_writeReg(fep, FEP_REG_BAUD, code);
+    if (response != FEP_P0) return response;
+
+    /* FEP starts at the new rate, so its answer to @RST isn't waited */
+    fprintf_P(fep_stream(fep), PSTR("@RST\r\n"));
+    FEP_sleepMs(6 * 10000UL / old + 2);
+    FEP_switchBaud(fep, baud);
+
+    if (FEP_waitReady(fep)) return FEP_P0;
+
+    /* FEP hasn't taken it */
+    fep->cfg.regValid &= ~((uint32_t)1 << FEP_REG_BAUD);
+    FEP_probeBaud(fep, old);
+    return FEP_NO_RESPONSE;
+}
+
+uint32_t fep_detectBaud(fep_t *fep) {
+    uint32_t current = fep->baud, baud;
+    uint8_t i;
+
+    if (FEP_probeBaud(fep, current)) return current;
+
+    for (i = FEP_BAUD_CODES; i-- > 0; ) {
+        baud = FEP_baudRates[i] * 100UL;
+        if (baud == current || !FEP_baudUsable(baud)) continue;
+        if (FEP_probeBaud(fep, baud)) return baud;
+    }
+
+    FEP_switchBaud(fep, current);
+    return 0;
+}
+
+static uint8_t FEP_baudCode(uint32_t baud) {
+    uint8_t i;
+
+    for (i = 0; i < FEP_BAUD_CODES; i++) {
+        if (FEP_baudRates[i] * 100UL == baud) break;
+    }
+    return i;
+}
+
+#if !defined( FEP_HOST )
+static uint16_t FEP_baudError(uint16_t select, uint32_t baud) {
+    /* 8 samples per bit at double speed, otherwise 16 */
+    uint32_t actual = F_CPU / (((select & 0x8000) ? 8UL : 16UL) * ((select & 0x0FFF) + 1));
+
+    return ((actual > baud) ? actual - baud : baud - actual) * 1000UL / baud;
+}
+#endif
+
+static uint8_t FEP_baudUsable(uint32_t baud) {
+#if defined( FEP_HOST )
+    /* the host's serial ports make the standard rates */
+    (void)baud;
+    return 1;
+#else
+    uint16_t select = FEP_uartBaudSelect(baud);
+
+    return FEP_baudError(select, baud) <= FEP_BAUD_ERROR_PERMILLE;
+#endif
+}
+
+static uint8_t FEP_probeBaud(fep_t *fep, uint32_t baud) {
+    FEP_switchBaud(fep, baud);
+    return FEP_ping(fep, FEP_BAUD_PROBE_MS);
+}
+
+static void FEP_switchBaud(fep_t *fep, uint32_t baud) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        (*fep->transport->init)(fep->transport->ctx, baud);
+        fep->baud = baud;
+        /* a line received at the old rate is broken */
+        fep->rx.state = FEP_RX_HEAD;
+        fep->rx.pos = 0;
+    }
+}
+
+static uint8_t FEP_ping(fep_t *fep, uint16_t timeout) {
+    char buf[FEP_REPLY_LEN + 1];
+    uint8_t response;
+
+    /* end the garbage FEP may have got at the wrong rate, and wait for
+     * the answer to it ("N0\r\n") */
+    fprintf_P(fep_stream(fep), PSTR("\r\n"));
+    FEP_sleepMs(6 * 10000UL / fep->baud + 2);
+
+    FEP_flushReplies(fep);
+    FEP_sendQuery(fep, 0);
+    response = FEP_waitResponseStr(fep, buf, timeout);
+    if (response == FEP_P0) FEP_storeItem(fep, 0, buf);
+
+    /* any answer means FEP hears us */
+    return (response != FEP_NO_RESPONSE);
+}
+
+uint8_t fep_readConfig(fep_t *fep) {
+#if defined( FEP_NO_QUERY )
+    (void)fep;
+    return FEP_N0;
+#else
+    return FEP_readItems(fep, 0xFFFFFFFF, FEP_CFG_ALL);
+#endif
+}
+
+#if !defined( FEP_NO_QUERY )
+static uint8_t FEP_readItems(fep_t *fep, uint32_t regs, uint8_t other) {
+    char buf[FEP_REPLY_LEN + 1];
+    uint8_t asked[FEP_REPLY_QUEUE_DEPTH];   /* items waiting for the reply */
+    uint8_t item = 0, sent = 0, got = 0, response = FEP_P0;
+
+    FEP_flushReplies(fep);
+
+    for (;;) {
+        /* send the next queries while FEP is answering the previous ones */
+        while ((uint8_t)(sent - got) < FEP_REPLY_QUEUE_DEPTH) {
+            while (item < FEP_ITEM_COUNT && !FEP_itemSelected(item, regs, other)) item++;
+            if (item >= FEP_ITEM_COUNT) break;
+            asked[sent++ & FEP_REPLY_QUEUE_MASK] = item;
+            FEP_sendQuery(fep, item++);
+        }
+        if (got == sent) break;
+
+        response = FEP_waitResponseStr(fep, buf, FEP_CMD_TIMEOUT_MS);
+        if (response == FEP_P0) response = FEP_storeItem(fep, asked[got++ & FEP_REPLY_QUEUE_MASK], buf);
+        if (response != FEP_P0) break;
+    }
+
+    return response;
+}
+
+static uint8_t FEP_itemSelected(uint8_t item, uint32_t regs, uint8_t other) {
+    if (item < FEP_ITEM_FRQ) return (regs & ((uint32_t)1 << item)) != 0;
+    if (item < FEP_ITEM_ID) return (other & FEP_CFG_FRQ(item - FEP_ITEM_FRQ + 1)) != 0;
+    return (other & FEP_CFG_ID) != 0;
+}
+#endif
+
+static void FEP_sendQuery(fep_t *fep, uint8_t item) {
+    if (item < FEP_ITEM_FRQ) {
+        fprintf_P(fep_stream(fep), PSTR("@REG%02d\r\n"), item);
+    } else if (item < FEP_ITEM_ID) {
+        fprintf_P(fep_stream(fep), PSTR("@FRQ%d\r\n"), item - FEP_ITEM_FRQ + 1);
+    } else {
+        fprintf_P(fep_stream(fep), PSTR("@IDR\r\n"));
+    }
+}
+
+static uint8_t FEP_storeItem(fep_t *fep, uint8_t item, const char *reply) {
+    unsigned int val;
+    uint8_t ch;
+
+    if (item < FEP_ITEM_FRQ) {
+        if (sscanf_P(reply, PSTR("%XH"), &val) != 1) return FEP_N0;
+        /* don't overwrite the value changed after fep_beginConfig() */
+        if (fep->cfg.regDirty & ((uint32_t)1 << item)) return FEP_P0;
+        fep->cfg.reg[item] = val;
+        fep->cfg.regValid |= (uint32_t)1 << item;
+    } else if (item < FEP_ITEM_ID) {
+        if (sscanf_P(reply, PSTR("%u"), &val) != 1) return FEP_N0;
+        ch = item - FEP_ITEM_FRQ + 1;
+        if (fep->cfg.dirty & FEP_CFG_FRQ(ch)) return FEP_P0;
+        fep->cfg.frq[ch - 1] = val;
+        fep->cfg.valid |= FEP_CFG_FRQ(ch);
+    } else {
+        if (sscanf_P(reply, PSTR("%XH"), &val) != 1) return FEP_N0;
+        if (fep->cfg.dirty & FEP_CFG_ID) return FEP_P0;
+        fep->cfg.id = val;
+        fep->cfg.valid |= FEP_CFG_ID;
+    }
+
+    return FEP_P0;
+}
+
+static uint8_t FEP_readItem(fep_t *fep, uint8_t item) {
+#if defined( FEP_NO_QUERY )
+    /* only what the library has written is known */
+    (void)fep;
+    (void)item;
+    return FEP_N0;
+#else
+    char buf[FEP_REPLY_LEN + 1];
+    uint8_t response;
+
+    FEP_flushReplies(fep);
+    FEP_sendQuery(fep, item);
+
+    response = FEP_waitResponseStr(fep, buf, FEP_CMD_TIMEOUT_MS);
+    if (response == FEP_P0) response = FEP_storeItem(fep, item, buf);
+
+    return response;
+#endif
+}
+
+static void FEP_flushReplies(fep_t *fep) {
+    /* the response of an asynchronous try isn't late */
+    FEP_txDrain(fep);
+    fep->replyTail = fep->replyHead;
+    fep->response = FEP_NO_RESPONSE;
+}
+
+void fep_beginConfig(fep_t *fep) {
+    fep->cfg.open = 1;
+}
+
+uint8_t fep_commitConfig(fep_t *fep) {
+    uint8_t response = FEP_P0, reset, i;
+
+    fep->cfg.open = 0;
+    reset = (fep->cfg.regDirty != 0);
+
+    for (i = 0; i < FEP_REG_COUNT && response == FEP_P0; i++) {
+        if (fep->cfg.regDirty & ((uint32_t)1 << i)) {
+            response = FEP_writeReg(fep, i, fep->cfg.reg[i]);
+        }
+    }
+    for (i = 1; i <= 3 && response == FEP_P0; i++) {
+        if (fep->cfg.dirty & FEP_CFG_FRQ(i)) {
+            response = FEP_writeFrq1(fep, i, fep->cfg.frq[i - 1]);
+        }
+    }
+    if ((fep->cfg.dirty & FEP_CFG_ID) && response == FEP_P0) {
+        response = FEP_writeID(fep, fep->cfg.id);
+    }
+
+    /* settings not written after a failure are unknown */
+    fep->cfg.regValid &= ~fep->cfg.regDirty;
+    fep->cfg.regDirty = 0;
+    fep->cfg.valid &= ~fep->cfg.dirty;
+    fep->cfg.dirty = 0;
+
+    /* activate the registers */
+    if (reset) {
+        reset = fep_reset(fep);
+        if (response == FEP_P0) response = reset;
+    }
+
+    return response;
+}
+
+static void FEP_sendPacket(fep_t *fep, uint8_t type, const char *data, size_t len, uint8_t addr, const fep_route_t *route, uint8_t seq) {
+    char head[4 + 3 * (FEP_MAX_REPEATERS + 2)];
+    uint8_t trailer = '0' + seq;
+    uint8_t n = 4, i, seqLen = (fep->seqOn && seq != FEP_SEQ_NONE) ? FEP_SEQ_LEN : 0;
+
+    /* forget a response which came too late for the previous command */
+    fep->response = FEP_NO_RESPONSE;
+
+    /* "@TXTaaa" or "@TBNaaalll". Through repeaters, "@TXR"/"@TBR" or
+     * "@TX2"/"@TB2" and the addresses of the repeaters before aaa */
+    head[0] = '@';
+    head[1] = 'T';
+    head[2] = (type == FEP_DT_STR) ? 'X' : 'B';
+    if (route->hops == 0) {
+        head[3] = (type == FEP_DT_STR) ? 'T' : 'N';
+    } else {
+        head[3] = (route->hops == 1) ? 'R' : '2';
+    }
+    for (i = 0; i < route->hops; i++, n += 3) {
+        FEP_putDec3(head + n, route->via[i]);
+    }
+    FEP_putDec3(head + n, addr);
+    n += 3;
+    if (type == FEP_DT_STR) {
+        FEP_STAT_INC(fep, sentStr);
+    } else {
+        FEP_putDec3(head + n, len + seqLen);
+        n += 3;
+        FEP_STAT_INC(fep, sentBin);
+    }
+    FEP_WRITE(fep, (const uint8_t *)head, n);
+    FEP_WRITE(fep, (const uint8_t *)data, len);
+    if (seqLen) FEP_WRITE(fep, &trailer, seqLen);
+    FEP_WRITE(fep, (const uint8_t *)"\r\n", 2);
+}
+
+static uint16_t FEP_maxDataLen(fep_t *fep) {
+    return fep->seqOn ? FEP_MAX_PAYLOAD - FEP_SEQ_LEN : FEP_MAX_PAYLOAD;
+}
+
+static uint8_t FEP_nextSeq(fep_t *fep) {
+    uint8_t seq = fep->txSeq;
+
+    fep->txSeq = (seq >= FEP_SEQ_MASK) ? 1 : seq + 1;
+    return seq;
+}
+
+static void FEP_putDec3(char *p, uint16_t val) {
+    uint8_t d;
+
+    for (d = 0; val >= 100; d++) val -= 100;
+    p[0] = '0' + d;
+    for (d = 0; val >= 10; d++) val -= 10;
+    p[1] = '0' + d;
+    p[2] = '0' + val;
+}
+
+static uint16_t FEP_wireTime(fep_t *fep, size_t len) {
+    /* "@TBNaaalll" + data + CRLF to FEP, and the packet on air */
+    return ((uint32_t)(len + 12) * 10000 + fep->baud - 1) / fep->baud
+         + ((uint32_t)(len + FEP_AIR_OVERHEAD) * 8000 + FEP_AIR_BPS - 1) / FEP_AIR_BPS;
+}
+
+static fep_peer_t *FEP_peerFind(fep_t *fep, uint8_t addr) {
+    uint8_t i;
+
+    for (i = 0; i < FEP_PEER_TABLE_SIZE; i++) {
+        if (fep->peer[i].known && fep->peer[i].addr == addr) return &fep->peer[i];
+    }
+    return NULL;
+}
+
+static fep_peer_t *FEP_peerGet(fep_t *fep, uint8_t addr) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+    uint32_t now = FEP_millis();
+    uint8_t i;
+
+    if (peer == NULL) {
+        /* an unused entry, or the one used least recently */
+        peer = &fep->peer[0];
+        for (i = 0; i < FEP_PEER_TABLE_SIZE && peer->known; i++) {
+            if (!fep->peer[i].known || (int32_t)(fep->peer[i].at - peer->at) < 0) {
+                peer = &fep->peer[i];
+            }
+        }
+        memset(peer, 0, sizeof(*peer));
+        peer->addr = addr;
+    }
+    peer->at = now;
+
+    return peer;
+}
+
+static void FEP_peerReceived(fep_t *fep, const fep_frame_t *frame) {
+    fep_peer_t *peer = FEP_peerGet(fep, frame->addr);
+    uint8_t i, hops = frame->route.hops;
+
+    if (hops > 0) {
+        /* the intensity is of the last repeater. The repeaters reach the
+         * peer in the reverse order */
+        if (peer->route.hops == 0) peer->probe = 0;
+        peer->known |= FEP_PEER_ROUTE;
+        peer->route.hops = hops;
+        for (i = 0; i < hops; i++) {
+            peer->route.via[i] = frame->route.via[hops - 1 - i];
+        }
+        return;
+    }
+
+    if (peer->known & FEP_PEER_RX) {
+        peer->intensity += frame->intensity - (peer->intensity >> FEP_PEER_GAIN);
+    } else {
+        peer->intensity = frame->intensity << FEP_PEER_GAIN;
+        peer->known |= FEP_PEER_RX;
+    }
+    peer->seen = peer->at;
+    /* the direct link works */
+    peer->relay = 0;
+}
+
+static void FEP_routePick(fep_t *fep, uint8_t addr, uint8_t first, fep_route_t *route) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+
+    route->hops = 0;
+    if (peer == NULL || peer->route.hops == 0 || !peer->relay) return;
+
+    /* try the direct link now and then, in case it has come back */
+    if (first && ++peer->probe >= FEP_ROUTE_PROBE) {
+        peer->probe = 0;
+        return;
+    }
+    *route = peer->route;
+}
+
+static void FEP_routeResult(fep_t *fep, uint8_t addr, uint8_t relayed, uint8_t response) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+
+    if (peer == NULL || peer->route.hops == 0) return;
+
+    if (response == FEP_P0) {
+        peer->relay = relayed;
+    } else if (response == FEP_N1) {
+        /* the other path next time */
+        peer->relay = !relayed;
+    }
+}
+
+static void FEP_peerResult(fep_t *fep, uint8_t addr, uint8_t response) {
+    fep_peer_t *peer;
+    uint16_t sample;
+
+    if (response != FEP_P0 && response != FEP_N1) return;
+
+    peer = FEP_peerGet(fep, addr);
+    sample = (response == FEP_P0) ? 65535 : 0;
+    if (peer->known & FEP_PEER_TX) {
+        peer->delivery += ((int32_t)sample - peer->delivery) >> FEP_PEER_GAIN;
+    } else {
+        peer->delivery = sample;
+        peer->known |= FEP_PEER_TX;
+    }
+}
+
+static uint16_t FEP_rttTimeout(fep_t *fep, uint8_t addr, size_t len, uint8_t hops, uint8_t retry) {
+    fep_peer_t *peer = FEP_peerFind(fep, addr);
+    uint32_t rto;
+
+    if (peer == NULL || !(peer->known & FEP_PEER_RTT)) {
+        rto = FEP_RTO_INIT_MS;
+    } else {
+        /* srtt + 4 * rttvar */
+        rto = (peer->srtt >> 3) + peer->rttvar;
+        if (rto < FEP_RTO_MIN_MS) rto = FEP_RTO_MIN_MS;
+    }
+
+    /* the part which depends on the length isn't in the samples */
+    rto += FEP_wireTime(fep, len);
+
+    /* every repeater sends the packet and the ACK again */
+    rto *= hops + 1;
+
+    /* double the timeout at every try */
+    if (retry > FEP_BACKOFF_MAX_EXP) retry = FEP_BACKOFF_MAX_EXP;
+    rto <<= retry;
+
+    return (rto > FEP_TIMEOUT_MS) ? FEP_TIMEOUT_MS : rto;
+}
+
+static void FEP_rttUpdate(fep_t *fep, uint8_t addr, size_t len, uint16_t elapsed) {
+    fep_peer_t *peer = FEP_peerGet(fep, addr);
+    uint16_t wire = FEP_wireTime(fep, len);
+    int16_t r, delta;
+
+    r = (elapsed > wire) ? elapsed - wire : 0;
+    if (r > FEP_TIMEOUT_MS) r = FEP_TIMEOUT_MS;
+
+    if (!(peer->known & FEP_PEER_RTT)) {
+        /* first sample */
+        peer->srtt = r << 3;
+        peer->rttvar = r << 1;
+        peer->known |= FEP_PEER_RTT;
+        return;
+    }
+
+    delta = r - (peer->srtt >> 3);
+    peer->srtt += delta;
+    if (delta < 0) delta = -delta;
+    peer->rttvar += delta - (peer->rttvar >> 2);
+}
+
+static uint16_t FEP_backoff(fep_t *fep, uint8_t retry) {
+    /* xorshift. modules with the same program must not wait the same time,
+     * so the seed is made from the address and the ID when they are known */
+    if (FEP_seed == 0) {
+        FEP_seed = (FEP_millis() ^ ((uint16_t)fep->cfg.reg[0] << 8) ^ fep->cfg.id) | 1;
+    }
+    FEP_seed ^= FEP_seed << 7;
+    FEP_seed ^= FEP_seed >> 9;
+    FEP_seed ^= FEP_seed << 8;
+
+    if (retry > FEP_BACKOFF_MAX_EXP) retry = FEP_BACKOFF_MAX_EXP;
+
+    return FEP_seed % ((uint16_t)FEP_BACKOFF_SLOT_MS << retry) + 1;
+}
+
+static uint8_t FEP_takeResponse(fep_t *fep) {
+    uint8_t response;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        response = fep->response;
+        fep->response = FEP_NO_RESPONSE;
+    }
+
+    return response;
+}
+
+static uint32_t FEP_millis(void) {
+    uint32_t ms;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ms = FEP_ms;
+    }
+
+    return ms;
+}
+
+static void FEP_idle(void) {
+#if defined( FEP_IDLE_SLEEP )
+    /* without FEP_tick(), nothing would end the sleep or advance the clock */
+    if (FEP_ticking) {
+#if defined( FEP_HOST )
+        FEP_hostSleep();
+#else
+        /* an interrupt which came just before sleeping is noticed at the
+         * next FEP_tick(), at most 1 ms later */
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
+#endif
+        return;
+    }
+#endif
+    _delay_ms(1);
+    /* busy waits are the clock until FEP_tick() runs */
+    if (!FEP_ticking) FEP_ms++;
+}
+
+static void FEP_sleepMs(uint16_t ms) {
+    uint16_t start = FEP_millis();
+
+    while ((uint16_t)(FEP_millis() - start) < ms) FEP_idle();
+}
+
+static uint8_t FEP_waitResponse(fep_t *fep, uint16_t timeout, uint16_t *elapsed) {
+    uint16_t start = FEP_millis();
+    uint8_t response = FEP_NO_RESPONSE;
+
+    for (; (uint16_t)(FEP_millis() - start) < timeout; FEP_idle()) {
+        if (fep->response != FEP_NO_RESPONSE) {
+            /* get response */
+            response = FEP_takeResponse(fep);
+
+            /* P1: command accepted, wait for the result of sending */
+            if (response != FEP_P1) break;
+            response = FEP_NO_RESPONSE;
+        }
+    }
+
+    if (elapsed != NULL) *elapsed = FEP_millis() - start;
+    return response;
+}
+
+static uint8_t FEP_waitResponseStr(fep_t *fep, char *buf, uint16_t timeout) {
+    volatile char *reply;
+    uint16_t start;
+    uint8_t j, response;
+
+    for (start = FEP_millis(); (uint16_t)(FEP_millis() - start) < timeout; FEP_idle()) {
+        if (fep->replyHead != fep->replyTail) {
+            /* get the oldest reply */
+            reply = fep->reply[fep->replyTail & FEP_REPLY_QUEUE_MASK];
+            for (j = 0; j < FEP_REPLY_LEN + 1; j++) {
+                buf[j] = reply[j];
+            }
+            fep->replyTail++;
+            return FEP_P0;
+        } else if (fep->response != FEP_NO_RESPONSE) {
+            /* a query is answered by a reply or refused (N0), so P0 and P1
+             * are late results of an earlier command */
+            response = FEP_takeResponse(fep);
+            if (response != FEP_P0 && response != FEP_P1) return response;
+        }
+    }
+
+    return FEP_NO_RESPONSE;
+}
+
+#if defined( FEP_HOST )
+static ssize_t FEP_hostStreamWrite(void *cookie, const char *buf, size_t size) {
+    fep_t *fep = cookie;
+
+    FEP_WRITE(fep, (const uint8_t *)buf, size);
+    return size;
+}
+
+FILE *fep_stream(fep_t *fep) {
+    cookie_io_functions_t io = { NULL, FEP_hostStreamWrite, NULL, NULL };
+
+    if (fep->stream == NULL) {
+        fep->stream = fopencookie(fep, "w", io);
+        setvbuf(fep->stream, NULL, _IONBF, 0);
+    }
+    return fep->stream;
+}
+#else
+int FEP_io_getchar(FILE *stream) {
+    /* every byte from FEP is decoded by fep_rxHandler. use fep_gets */
+    return _FDEV_EOF;
+}
+
+int FEP_io_putchar(char c, FILE *stream) {
+    fep_t *fep = fdev_get_udata(stream);
+
+    FEP_WRITE(fep, (const uint8_t *)&c, 1);
+    return 0;
+}
+
+FILE *fep_stream(fep_t *fep) {
+    return &fep->stream;
+}
+#endif
 
-    /* initialize global variables */
-    FEP_intensity = 0;
-    FEP_availableFlag = 0;
-    FEP_transmitterAddr = 0;
+uint16_t fep_available(fep_t *fep) {
+	return (uint8_t)(fep->rxHead - fep->rxTail);
+}
 
-    /* set uart functions */
-    switch (module) {
-#if defined( USART0_ENABLED )
-        case 0:
-            FEP_uart_init = &uart0_init;
-            FEP_uart_setRxHandler = &uart0_setRxHandler;
-            FEP_uart_getc = &uart0_getc;
-            FEP_uart_peek = &uart0_peek;
-            FEP_uart_putc = &uart0_putc;
-            FEP_uart_available = &uart0_available;
-            FEP_uart_flush = &uart0_flush;
-            break;
-#endif
-#if defined( USART1_ENABLED )
-        case 1:
-            FEP_uart_init = &uart1_init;
-            FEP_uart_setRxHandler = &uart1_setRxHandler;
-            FEP_uart_getc = &uart1_getc;
-            FEP_uart_peek = &uart1_peek;
-            FEP_uart_putc = &uart1_putc;
-            FEP_uart_available = &uart1_available;
-            FEP_uart_flush = &uart1_flush;
-            break;
-#endif
-#if defined( USART2_ENABLED )
-        case 2:
-            FEP_uart_init = &uart2_init;
-            FEP_uart_setRxHandler = &uart2_setRxHandler;
-            FEP_uart_getc = &uart2_getc;
-            FEP_uart_peek = &uart2_peek;
-            FEP_uart_putc = &uart2_putc;
-            FEP_uart_available = &uart2_available;
-            FEP_uart_flush = &uart2_flush;
-            break;
-#endif
-#if defined( USART3_ENABLED )
-        case 3:
-            FEP_uart_init = &uart3_init;
-            FEP_uart_setRxHandler = &uart3_setRxHandler;
-            FEP_uart_getc = &uart3_getc;
-            FEP_uart_peek = &uart3_peek;
-            FEP_uart_putc = &uart3_putc;
-            FEP_uart_available = &uart3_available;
-            FEP_uart_flush = &uart3_flush;
-            break;
-#endif
-        default:
-            /* error! The module # is wrong! */
-            return;
+void fep_setSequence(fep_t *fep, uint8_t enable) {
+    fep->seqOn = enable;
+}
+
+uint8_t fep_setPeerSequence(fep_t *fep, int16_t addr, uint8_t enable) {
+    uint8_t i;
+
+    if (addr < FEP_ANY_ADDR || addr > 255) return FEP_N0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (addr == FEP_ANY_ADDR) {
+            memset(fep->seqFrom, enable ? 0xFF : 0, sizeof(fep->seqFrom));
+        } else if (enable) {
+            fep->seqFrom[addr >> 3] |= 1 << (addr & 7);
+        } else {
+            fep->seqFrom[addr >> 3] &= ~(1 << (addr & 7));
+        }
+        /* start the windows again */
+        for (i = 0; i < FEP_SEQ_TABLE_SIZE; i++) {
+            if (addr == FEP_ANY_ADDR || fep->seqWin[i].addr == addr) fep->seqWin[i].used = 0;
+        }
     }
 
-    /* Initialize uart module */
-    (*FEP_uart_init)(UART_BAUD_SELECT(38400, F_CPU));
+    return FEP_P0;
+}
 
-    /* Set additional rx interrupt handler */
-    (*FEP_uart_setRxHandler)(FEP_rxHandler);
+uint16_t fep_getRxOverflow(fep_t *fep) {
+    uint16_t overflow;
 
-    /* enable interrupt */
-    sei();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        overflow = fep->rxOverflow;
+    }
 
-    /* wait until fep starts */
-    _delay_ms(60);
+    return overflow;
+}
 
-    /* Add intensity to response */
-    //FEP_setReg(13, (1 << 7));
+void fep_getStats(fep_t *fep, fep_stats_t *stats) {
+#if defined( FEP_STATS )
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stats = fep->stats;
+    }
+#else
+    (void)fep;
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
 
-    //FEP_setMyAddr(addr);
-    //FEP_setFrq(ch1, ch2, ch3);
-    //FEP_setID(id);
+void fep_resetStats(fep_t *fep) {
+#if defined( FEP_STATS )
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset(&fep->stats, 0, sizeof(fep->stats));
+    }
+#else
+    (void)fep;
+#endif
 }
 
-uint8_t FEP_puts(char *str, uint8_t addr) {
-    uint8_t response, i;
+void fep_rxHandler(fep_t *fep, uint8_t data, uint8_t error) {
+    FEP_rxDecode(fep, data, error);
+}
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@TXT%03d%s\r\n"), addr, str);
+static void FEP_rxDecode(void *arg, uint8_t data, uint8_t error) {
+    fep_t *fep = arg;
+    volatile fep_frame_t *frame = &fep->rxQueue[fep->rxHead & FEP_RX_QUEUE_MASK];
+#if defined( FEP_STATS ) && defined( FEP_STATS_CLOCK )
+    uint16_t start = FEP_STATS_CLOCK();
+#endif
 
-        response = FEP_waitResponse();
-        if (response == FEP_P0) break;
+    if (error) {
+        /* the line is broken */
+        fep->rx.state = FEP_RX_SKIP;
     }
 
-    _delay_us(100);
+    switch (fep->rx.state) {
+        case FEP_RX_HEAD:
+            if (fep->rx.pos == 0) {
+                /* beginning of a line */
+                fep->rx.type = FEP_DT_LINE;
+                fep->rx.drop = ((uint8_t)(fep->rxHead - fep->rxTail) >= FEP_RX_QUEUE_DEPTH);
+            }
+            if (data == '\r') {
+                fep->rx.state = FEP_RX_LF;
+                break;
+            }
+            FEP_rxStore(fep, frame, data);
+            if (fep->rx.pos == 3) {
+                /* RXT/RBN, or relayed by one (RXR/RBR) or two (RX2/RB2) repeaters */
+                if (fep->rx.head[2] == 'R') {
+                    fep->rx.hops = 1;
+                } else if (fep->rx.head[2] == '2') {
+                    fep->rx.hops = 2;
+                } else {
+                    fep->rx.hops = 0;
+                }
+                if (fep->rx.head[0] == 'R' && fep->rx.head[1] == 'X' && (fep->rx.hops || fep->rx.head[2] == 'T')) {
+                    fep->rx.type = FEP_DT_STR;
+                } else if (fep->rx.head[0] == 'R' && fep->rx.head[1] == 'B' && (fep->rx.hops || fep->rx.head[2] == 'N')) {
+                    fep->rx.type = FEP_DT_BIN;
+                } else {
+                    fep->rx.state = FEP_RX_TEXT;
+                    break;
+                }
+#if defined( FEP_RX_DROP_OLDEST )
+                if (fep->rx.drop && !fep->rxHeld) {
+                    /* queue is full: drop the oldest frame for this packet.
+                     * Its slot is the one the packet is stored to. */
+                    fep->rxTail++;
+                    fep->rxAccounted = 0;
+                    fep->rx.drop = 0;
+                    if (fep->rxOverflow != 0xFFFF) fep->rxOverflow++;
+                    FEP_STAT_INC(fep, rxDropped);
+                }
+#endif
+                /* data starts after the header */
+                fep->rx.addrs = 0;
+                fep->rx.pos = 0;
+                fep->rx.digits = 0;
+                fep->rx.value = 0;
+                fep->rx.state = FEP_RX_ADDR;
+            }
+            break;
 
-    return response;
-}
+        case FEP_RX_ADDR:
+        case FEP_RX_LEN:
+        case FEP_RX_INT:
+            if (data == '\r' && fep->rx.state == FEP_RX_INT) {
+                fep->rx.state = FEP_RX_LF;
+                break;
+            }
+            if (data < '0' || data > '9' || fep->rx.digits >= 3) {
+                fep->rx.state = FEP_RX_SKIP;
+                break;
+            }
+            fep->rx.value = fep->rx.value * 10 + (data - '0');
+            if (++fep->rx.digits < 3) break;
+
+            if (fep->rx.state == FEP_RX_ADDR) {
+                /* the transmitter, then the repeaters */
+                if (!fep->rx.drop) {
+                    if (fep->rx.addrs == 0) {
+                        frame->addr = fep->rx.value;
+                    } else {
+                        frame->route.via[fep->rx.addrs - 1] = fep->rx.value;
+                    }
+                }
+                if (fep->rx.addrs++ < fep->rx.hops) {
+                    fep->rx.digits = 0;
+                    fep->rx.value = 0;
+                    break;
+                }
+                if (fep->rx.type == FEP_DT_STR) {
+                    fep->rx.state = FEP_RX_TEXT;
+                } else {
+                    fep->rx.state = FEP_RX_LEN;
+                    fep->rx.digits = 0;
+                    fep->rx.value = 0;
+                }
+            } else if (fep->rx.state == FEP_RX_LEN) {
+                if (fep->rx.value > FEP_MAX_PAYLOAD) {
+                    fep->rx.state = FEP_RX_SKIP;
+                    break;
+                }
+                fep->rx.remain = fep->rx.value;
+                fep->rx.digits = 0;
+                fep->rx.value = 0;
+                fep->rx.state = (fep->rx.remain > 0) ? FEP_RX_BIN : FEP_RX_INT;
+            }
+            break;
 
-uint8_t FEP_putbin(char *ary, size_t len, uint8_t addr) {
-    uint8_t response, i, j;
+        case FEP_RX_BIN:
+            /* binary data may contain CRLF, so count the length */
+            FEP_rxStore(fep, frame, data);
+            if (--fep->rx.remain == 0) fep->rx.state = FEP_RX_INT;
+            break;
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@TBN%03d%03d"), addr, len);
-        for (j = 0; j < len; j++) {
-            fputc(*(ary + j), &fepio);
-        }
-        fputc('\r', &fepio);
-        fputc('\n', &fepio);
+        case FEP_RX_TEXT:
+            if (data == '\r') {
+                fep->rx.state = FEP_RX_LF;
+            } else {
+                FEP_rxStore(fep, frame, data);
+            }
+            break;
 
-        response = FEP_waitResponse();
-        if (response == FEP_P0) break;
+        case FEP_RX_LF:
+            if (data == '\n') {
+                /* received terminator */
+                FEP_rxEndLine(fep, frame);
+                fep->rx.state = FEP_RX_HEAD;
+                fep->rx.pos = 0;
+            } else if (fep->rx.type == FEP_DT_BIN) {
+                fep->rx.state = FEP_RX_SKIP;
+            } else {
+                /* CR without LF is a part of string */
+                FEP_rxStore(fep, frame, '\r');
+                if (data != '\r') {
+                    fep->rx.state = FEP_RX_TEXT;
+                    FEP_rxStore(fep, frame, data);
+                }
+            }
+            break;
+
+        default: /* FEP_RX_SKIP */
+            if (data == '\n') {
+                FEP_STAT_INC(fep, parseErrors);
+                fep->rx.state = FEP_RX_HEAD;
+                fep->rx.pos = 0;
+            }
+            break;
     }
 
-    _delay_us(100);
+#if defined( FEP_STATS ) && defined( FEP_STATS_CLOCK )
+    start = FEP_STATS_CLOCK() - start;
+    if (start > fep->stats.isrMax) fep->stats.isrMax = start;
+#endif
 
-    return response;
+    return;
 }
 
-uint8_t FEP_gets(char *str, size_t len) {
-    uint16_t intensity, i;
-    uint8_t data_mode;
-    size_t data_len;
-    char buf[FEP_LINE_LEN], sub[FEP_LINE_LEN];
-
-    /* skip over old datas */
-    if (FEP_fgets(buf, FEP_LINE_LEN, &fepio) == NULL) return FEP_DT_ERR;
-
-    /* Parse command */
-    if (strlen(buf) >= 3) {
-        /* get command part */
-        strncpy(sub, buf, 3);
-        sub[3] = '\0';
-        if (!strcmp(sub, "RXT")) {
-            /* Subtract string from a part before the intensity  */
-            strncpy(sub, buf, strlen(buf) - 3 - 2);
-            sub[strlen(buf) - 3 - 2 + 1] = '\0';
-
-            /* Get transmitter's address */
-            sscanf_P(sub, PSTR("RXT%03d"), &FEP_transmitterAddr);
-            /* Store message to str */
-            strncpy(str, buf + 6, strlen(buf) - 6 - 3 - 2);
-
-            /* Get intensity part of string */
-            strncpy(sub, buf + strlen(buf) - 3 - 2, 3);
-            sub[3] = '\0';
-
-            data_mode = FEP_DT_STR;
-        } else if (!strcmp(sub, "RBN")) {
-            /* addr and length part */
-            strncpy(sub, buf + 3, 6);
-            sub[6] = '\0';
-
-            /* Get transmitter's address & data length */
-            sscanf_P(sub, PSTR("%03d%03d"), &FEP_transmitterAddr, &data_len);
-            /* Store binary data to array */
-            if (data_len > len) {
-                /* received data is too long! */
-                return 0;
-            }
-            /* memcpy(str, buf + 9, data_len); */
-            for (i = 0; i < data_len; i++) {
-                str[i] = buf[i + 9];
+static void FEP_rxStore(fep_t *fep, volatile fep_frame_t *frame, uint8_t c) {
+    if (fep->rx.pos >= sizeof(frame->data) - 1) {
+        /* the line is too long */
+        fep->rx.state = FEP_RX_SKIP;
+        return;
+    }
+    if (fep->rx.pos < FEP_REPLY_LEN && fep->rx.type == FEP_DT_LINE) {
+        fep->rx.head[fep->rx.pos] = c;
+    }
+    if (!fep->rx.drop) frame->data[fep->rx.pos] = c;
+    fep->rx.pos++;
+}
+
+static void FEP_rxEndLine(fep_t *fep, volatile fep_frame_t *frame) {
+    volatile char *reply;
+    uint16_t len = fep->rx.pos;
+    uint8_t i;
+
+    if (fep->rx.type == FEP_DT_LINE) {
+        if (len == 0) return;
+
+        /* response to a command */
+        if (len == 2 && fep->rx.head[0] == 'P' && (fep->rx.head[1] == '0' || fep->rx.head[1] == '1')) {
+            fep->response = FEP_P0 + (fep->rx.head[1] - '0');
+            FEP_STAT_INC(fep, response[fep->response - FEP_P0]);
+            return;
+        }
+        if (len == 2 && fep->rx.head[0] == 'N' && fep->rx.head[1] >= '0' && fep->rx.head[1] <= '3') {
+            fep->response = FEP_N0 + (fep->rx.head[1] - '0');
+            FEP_STAT_INC(fep, response[fep->response - FEP_P0]);
+            return;
+        }
+
+        /* reply to a query command */
+        if (len <= FEP_REPLY_LEN &&
+            !(fep->rx.head[0] == 'R' && (fep->rx.head[1] == 'B' || fep->rx.head[1] == 'X')))
+        {
+            /* the reply is dropped if nobody is reading */
+            if ((uint8_t)(fep->replyHead - fep->replyTail) < FEP_REPLY_QUEUE_DEPTH) {
+                reply = fep->reply[fep->replyHead & FEP_REPLY_QUEUE_MASK];
+                for (i = 0; i < len; i++) {
+                    reply[i] = fep->rx.head[i];
+                }
+                reply[len] = '\0';
+                fep->replyHead++;
             }
+            return;
+        }
+    }
 
-            /* Get intensity part of string */
-            strncpy(sub, buf + 9 + data_len, 3);
-            sub[3] = '\0';
+    if (fep->rx.drop) {
+        /* queue is full: drop the newest frame */
+        if (fep->rxOverflow != 0xFFFF) fep->rxOverflow++;
+        FEP_STAT_INC(fep, rxDropped);
+        return;
+    }
 
-            data_mode = FEP_DT_BIN;
+    if (fep->rx.type == FEP_DT_STR) {
+        /* intensity is the last 3 characters of the string */
+        if (len >= 3) {
+            len -= 3;
+            fep->rx.value = (frame->data[len] - '0') * 100
+                          + (frame->data[len + 1] - '0') * 10
+                          + (frame->data[len + 2] - '0');
+        } else {
+            fep->rx.value = 0;
         }
+    }
 
-        /* Import intensity */
-        sscanf_P(sub, PSTR("%03d"), &intensity);
-        FEP_intensity = intensity;
+    if (fep->rx.type == FEP_DT_BIN && fep->tdma.role == FEP_TDMA_NODE && fep->rx.hops == 0 &&
+        len == FEP_TDMA_BEACON_LEN && (uint8_t)frame->data[0] == FEP_TDMA_MAGIC)
+    {
+        /* TDMA beacon, which has no sequence number: the frame starts
+         * now */
+        fep->tdma.slots = frame->data[1];
+        fep->tdma.slotMs = ((uint16_t)(uint8_t)frame->data[2] << 8) | (uint8_t)frame->data[3];
+        fep->tdma.beaconAt = FEP_ms;
+        return;
     }
 
-    return data_mode;
-}
+    if (fep->rx.type != FEP_DT_LINE && (fep->seqFrom[frame->addr >> 3] & (1 << (frame->addr & 7)))) {
+        /* the sequence number is the last character of the data */
+        if (len < FEP_SEQ_LEN) return;
+        if (FEP_rxDuplicate(fep, frame->addr, frame->data[len - 1])) {
+            FEP_STAT_INC(fep, duplicates);
+            return;
+        }
+        len -= FEP_SEQ_LEN;
+    }
 
-uint8_t FEP_getTransmitterAddr(void) {
-    return FEP_transmitterAddr;
+    if (fep->rx.type == FEP_DT_LINE) frame->addr = 0;
+    frame->route.hops = (fep->rx.type == FEP_DT_LINE) ? 0 : fep->rx.hops;
+    frame->type = fep->rx.type;
+    frame->len = len;
+    frame->data[len] = '\0';
+    frame->intensity = (fep->rx.type == FEP_DT_LINE) ? 0 : fep->rx.value;
+    if (fep->rx.type != FEP_DT_LINE) FEP_STAT_RECEIVED(fep, fep->rx.type, fep->rx.value);
+
+    /* publish the frame */
+    fep->rxHead++;
 }
 
-uint8_t FEP_flushFEP(void) {
-    uint8_t response, i;
+static uint8_t FEP_rxDuplicate(fep_t *fep, uint8_t addr, uint8_t c) {
+    fep_seqwin_t *win = NULL, *home;
+    uint8_t seq = c - '0', diff, i;
+    uint32_t now = FEP_ms;
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@BCL\r\n"));
+    /* not a sequence number: let the application see it */
+    if (seq > FEP_SEQ_MASK) return 0;
 
-        response = FEP_waitResponse();
+    /* the entry at the address modulo the size, unless another
+     * transmitter has taken it */
+    home = &fep->seqWin[addr % FEP_SEQ_TABLE_SIZE];
+    if (home->used && home->addr == addr) {
+        win = home;
+    } else {
+        for (i = 0; i < FEP_SEQ_TABLE_SIZE; i++) {
+            if (fep->seqWin[i].used && fep->seqWin[i].addr == addr) {
+                win = &fep->seqWin[i];
+                break;
+            }
+        }
+    }
+    if (win == NULL) {
+        /* the own entry, an unused one, or the one heard from least
+         * recently */
+        win = home;
+        for (i = 0; i < FEP_SEQ_TABLE_SIZE && win->used; i++) {
+            if (!fep->seqWin[i].used || (int32_t)(fep->seqWin[i].at - win->at) < 0) {
+                win = &fep->seqWin[i];
+            }
+        }
+        win->used = 0;
+    }
 
-        if (response == FEP_P0) break;
+    if (!win->used || now - win->at > FEP_SEQ_AGE_MS ||
+        (seq == 0 && win->last != 0))
+    {
+        /* new transmitter, or the transmitter has restarted */
+        win->addr = addr;
+        win->used = 1;
+        win->last = seq;
+        win->window = 1;
+        win->at = now;
+        return 0;
+    }
+    win->at = now;
+
+    diff = (seq - win->last) & FEP_SEQ_MASK;
+    if (diff == 0) return 1;
+    if (diff <= FEP_SEQ_MASK / 2) {
+        /* newer than the last: slide the window */
+        win->window = (diff < FEP_SEQ_WINDOW) ? (win->window << diff) | 1 : 1;
+        win->last = seq;
+        return 0;
     }
 
-    return response;
+    /* older than the last, e.g. arrived late */
+    diff = FEP_SEQ_MASK + 1 - diff;
+    if (diff >= FEP_SEQ_WINDOW) return 0;
+    if (win->window & (1 << diff)) return 1;
+    win->window |= 1 << diff;
+    return 0;
 }
 
-uint8_t FEP_getReg(uint8_t reg_num) {
-    char buf[6];
-    uint8_t val;
+#if defined( FEP_STATS )
+static void FEP_statReceived(fep_t *fep, uint8_t type, uint16_t intensity) {
+    uint16_t bin = intensity / (256 / FEP_STATS_INTENSITY_BINS);
 
-    fprintf_P(&fepio, PSTR("@REG%02d\r\n"), reg_num);
+    if (type == FEP_DT_STR) {
+        FEP_STAT_INC(fep, recvStr);
+    } else {
+        FEP_STAT_INC(fep, recvBin);
+    }
+    if (bin >= FEP_STATS_INTENSITY_BINS) bin = FEP_STATS_INTENSITY_BINS - 1;
+    FEP_STAT_INC(fep, intensity[bin]);
+}
 
-    FEP_waitResponseStr(buf, 3);
+static void FEP_statTries(fep_t *fep, uint8_t n) {
+    if (n == 0) return;
+    if (n > FEP_STATS_TRY_BINS) n = FEP_STATS_TRY_BINS;
+    FEP_STAT_INC(fep, tries[n - 1]);
+}
+#endif
 
-    sscanf_P(buf, PSTR("%XH"), &val);
+/*
+ * functions of FEP_default
+ */
+void FEP_init(uint8_t module, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id) {
+    fep_init(&FEP_default, module, addr, ch1, ch2, ch3, id);
+}
 
-    return val;
+void FEP_initTransport(const fep_transport_t *transport, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id) {
+    fep_initTransport(&FEP_default, transport, addr, ch1, ch2, ch3, id);
 }
 
-uint8_t FEP_setReg(uint8_t reg_num, uint8_t val) {
-    uint8_t response, i;
+uint8_t FEP_initProfile(const fep_transport_t *transport, const fep_profile_t *profile) {
+    return fep_initProfile(&FEP_default, transport, profile);
+}
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@REG%02d:%03d\r\n"), reg_num, val);
+uint8_t FEP_applyProfile(const fep_profile_t *profile) {
+    return fep_applyProfile(&FEP_default, profile);
+}
 
-        response = FEP_waitResponse();
+uint16_t FEP_getBootTime(void) {
+    return fep_getBootTime(&FEP_default);
+}
 
-        if (response == FEP_P0) break;
-    }
+#if !defined( FEP_NO_STR )
+uint8_t FEP_puts(char *str, uint8_t addr) {
+    return fep_puts(&FEP_default, str, addr);
+}
 
-    FEP_reset();
-    return response;
+uint8_t FEP_putsTimeout(char *str, uint8_t addr, uint16_t timeout) {
+    return fep_putsTimeout(&FEP_default, str, addr, timeout);
 }
 
-int16_t FEP_getIntensity(void) {
-    return FEP_intensity;
+uint8_t FEP_putsVia(char *str, uint8_t addr, const fep_route_t *route) {
+    return fep_putsVia(&FEP_default, str, addr, route);
 }
 
-uint8_t FEP_getMyAddr(void) {
-    return FEP_getReg(0);
+uint8_t FEP_putsAsync(const char *str, uint8_t addr, fep_callback_t cb, void *arg) {
+    return fep_putsAsync(&FEP_default, str, addr, cb, arg);
 }
 
-uint8_t FEP_setMyAddr(uint8_t addr) {
-    return FEP_setReg(0, addr);
+uint8_t FEP_putsAsyncPrio(const char *str, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg) {
+    return fep_putsAsyncPrio(&FEP_default, str, addr, prio, cb, arg);
 }
+#endif
 
-void FEP_getFrq(uint8_t *ch1, uint8_t *ch2, uint8_t *ch3) {
-    *ch1 = FEP_getFrq1(1);
-    *ch2 = FEP_getFrq1(2);
-    *ch3 = FEP_getFrq1(3);
+#if !defined( FEP_NO_BIN )
+uint8_t FEP_putbin(char *ary, size_t len, uint8_t addr) {
+    return fep_putbin(&FEP_default, ary, len, addr);
 }
 
-uint8_t FEP_getFrq1(uint8_t ch) {
-    char buf[5];
-    uint8_t band;
+uint8_t FEP_putbinTimeout(char *ary, size_t len, uint8_t addr, uint16_t timeout) {
+    return fep_putbinTimeout(&FEP_default, ary, len, addr, timeout);
+}
 
-    fprintf_P(&fepio, PSTR("@FRQ%d\r\n"), ch);
+uint8_t FEP_putbinVia(char *ary, size_t len, uint8_t addr, const fep_route_t *route) {
+    return fep_putbinVia(&FEP_default, ary, len, addr, route);
+}
 
-    FEP_waitResponseStr(buf, 2);
+uint8_t FEP_sendBulk(const char *data, uint16_t len, uint8_t addr) {
+    return fep_sendBulk(&FEP_default, data, len, addr);
+}
 
-    sscanf_P(buf, PSTR("%d"), &band);
+uint8_t FEP_recvBulk(fep_bulk_t *bulk, uint16_t timeout) {
+    return fep_recvBulk(&FEP_default, bulk, timeout);
+}
 
-    return band;
+uint8_t FEP_batchPut(fep_batch_t *batch, const char *msg, uint8_t len, uint8_t addr) {
+    return fep_batchPut(&FEP_default, batch, msg, len, addr);
 }
 
-uint8_t FEP_setFrq(uint8_t ch1, uint8_t ch2, uint8_t ch3) {
-    if (FEP_setFrq1(1, ch1) == FEP_N0) return FEP_N0;
-    if (FEP_setFrq1(2, ch2) == FEP_N0) return FEP_N0;
-    if (FEP_setFrq1(3, ch3) == FEP_N0) return FEP_N0;
+uint8_t FEP_batchFlush(fep_batch_t *batch) {
+    return fep_batchFlush(&FEP_default, batch);
+}
 
-    return FEP_P0;
+uint8_t FEP_batchPoll(fep_batch_t *batch) {
+    return fep_batchPoll(&FEP_default, batch);
 }
 
-uint8_t FEP_setFrq1(uint8_t ch, uint8_t band) {
-    uint8_t response, i;
+void FEP_pipeOpen(fep_pipe_t *pipe, uint8_t addr) {
+    fep_pipeOpen(&FEP_default, pipe, addr);
+}
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@FRQ%1d:%02d\r\n"), ch, band);
+uint8_t FEP_putbinAsync(const char *ary, size_t len, uint8_t addr, fep_callback_t cb, void *arg) {
+    return fep_putbinAsync(&FEP_default, ary, len, addr, cb, arg);
+}
 
-        response = FEP_waitResponse();
+uint8_t FEP_putbinAsyncPrio(const char *ary, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg) {
+    return fep_putbinAsyncPrio(&FEP_default, ary, len, addr, prio, cb, arg);
+}
+#endif
 
-        if (response == FEP_P0) break;
-    }
+uint8_t FEP_setRoute(uint8_t addr, const fep_route_t *route) {
+    return fep_setRoute(&FEP_default, addr, route);
+}
 
-    return response;
+uint8_t FEP_getRoute(uint8_t addr, fep_route_t *route) {
+    return fep_getRoute(&FEP_default, addr, route);
 }
 
-uint16_t FEP_getID(void) {
-    char buf[8];
-    uint16_t id;
+void FEP_poll(void) {
+    fep_poll(&FEP_default);
+}
 
-    fprintf_P(&fepio, PSTR("@IDR\r\n"));
+uint8_t FEP_setTxQueue(uint8_t prio, uint8_t depth, uint16_t maxAge) {
+    return fep_setTxQueue(&FEP_default, prio, depth, maxAge);
+}
 
-    FEP_waitResponseStr(buf, 5);
+uint8_t FEP_onReceive(int16_t addr, uint8_t type, fep_handler_t handler, void *arg) {
+    return fep_onReceive(&FEP_default, addr, type, handler, arg);
+}
 
-    sscanf_P(buf, PSTR("%XH"), &id);
+uint8_t FEP_txPending(void) {
+    return fep_txPending(&FEP_default);
+}
 
-    return id;
+uint8_t FEP_tdmaStart(uint8_t slots, uint16_t slotMs, uint8_t slot) {
+    return fep_tdmaStart(&FEP_default, slots, slotMs, slot);
 }
 
-uint8_t FEP_setID(uint16_t id) {
-    uint8_t response, i;
+uint8_t FEP_tdmaJoin(uint8_t slot) {
+    return fep_tdmaJoin(&FEP_default, slot);
+}
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@IDW%4XH\r\n"), id);
+void FEP_tdmaStop(void) {
+    fep_tdmaStop(&FEP_default);
+}
 
-        response = FEP_waitResponse();
+uint8_t FEP_gets(char *str, size_t len) {
+    return fep_gets(&FEP_default, str, len);
+}
 
-        if (response == FEP_P0) break;
-    }
+uint8_t FEP_recvFrame(const fep_frame_t **out) {
+    return fep_recvFrame(&FEP_default, out);
+}
 
-    return response;
+void FEP_releaseFrame(void) {
+    fep_releaseFrame(&FEP_default);
 }
 
-uint8_t FEP_reset(void) {
-    uint8_t response, i;
+uint8_t FEP_getTransmitterAddr(void) {
+    return fep_getTransmitterAddr(&FEP_default);
+}
 
-    for (i = 0; i < FEP_RETRY; i++) {
-        fprintf_P(&fepio, PSTR("@RST\r\n"));
+uint8_t FEP_flushFEP(void) {
+    return fep_flushFEP(&FEP_default);
+}
 
-        response = FEP_waitResponse();
+uint8_t FEP_getReg(uint8_t reg_num) {
+    return fep_getReg(&FEP_default, reg_num);
+}
 
-        if (response == FEP_P0) break;
-    }
+uint8_t FEP_setReg(uint8_t reg_num, uint8_t val) {
+    return fep_setReg(&FEP_default, reg_num, val);
+}
 
-    return response;
+int16_t FEP_getIntensity(void) {
+    return fep_getIntensity(&FEP_default);
 }
 
-uint8_t FEP_waitResponse(void) {
-    uint16_t i;
-    char buf[258];
+uint8_t FEP_getLink(uint8_t addr, fep_link_t *link) {
+    return fep_getLink(&FEP_default, addr, link);
+}
 
-    for(i = 0; i < FEP_TIMEOUT_MS; i++) {
-        if (FEP_available()) {
-            /* get response */
-            FEP_fgets(buf, sizeof(buf), &fepio);
-            if (strlen(buf) > 4) {
-                /* the packet in buffer is not response, continue to wait */
-                continue;
-            }
+uint8_t FEP_getLinks(fep_link_t *links, uint8_t max) {
+    return fep_getLinks(&FEP_default, links, max);
+}
 
-            if (strcmp(buf, "P1\r\n") == 0) {
-                return FEP_waitResponse();
-            } else {
-                if (strcmp(buf, "P0\r\n") == 0) {
-                    return FEP_P0;
-                } else if (strcmp(buf, "N0\r\n") == 0) {
-                    return FEP_N0;
-                } else if (strcmp(buf, "N1\r\n") == 0) {
-                    return FEP_N1;
-                } else if (strcmp(buf, "N2\r\n") == 0) {
-                    return FEP_N2;
-                } else if (strcmp(buf, "N3\r\n") == 0) {
-                    return FEP_N3;
-                } else {
-                    continue;
-                }
-            }
-        } else {
-            _delay_ms(1);
-        }
-    }
-    return FEP_NO_RESPONSE;
+uint8_t FEP_getMyAddr(void) {
+    return fep_getMyAddr(&FEP_default);
 }
 
-char *FEP_waitResponseStr(char *buf, size_t len) {
-    size_t i;
-    char * ret;
+uint8_t FEP_setMyAddr(uint8_t addr) {
+    return fep_setMyAddr(&FEP_default, addr);
+}
 
-    for(i = 0; i < FEP_TIMEOUT_MS; i++) {
-        if (FEP_available()) {
-            /* get latest packet */
-            ret = FEP_fgets(buf, len + 2 + 1, &fepio);
+void FEP_getFrq(uint8_t *ch1, uint8_t *ch2, uint8_t *ch3) {
+    fep_getFrq(&FEP_default, ch1, ch2, ch3);
+}
 
-            /* check whether the packet is message from other transmitter or not */
-            if (buf[0] == 'R' &&
-                (buf[1] == 'B' || buf[1] == 'X') &&
-                (buf[2] == 'N' || buf[2] == 'R' || buf[2] == 'T' || buf[2] == '2'))
-            {
-                continue;
-            }
-        } else {
-            _delay_ms(1);
-        }
-    }
+uint8_t FEP_setFrq(uint8_t ch1, uint8_t ch2, uint8_t ch3) {
+    return fep_setFrq(&FEP_default, ch1, ch2, ch3);
+}
 
-    return ret;
+uint16_t FEP_getID(void) {
+    return fep_getID(&FEP_default);
 }
 
-int FEP_io_getchar(FILE *stream) {
-    uint16_t status, data;
+uint8_t FEP_setID(uint16_t id) {
+    return fep_setID(&FEP_default, id);
+}
 
-    if ((*FEP_uart_available)() <= 0) {
-        return _FDEV_ERR;
-    }
+uint8_t FEP_reset(void) {
+    return fep_reset(&FEP_default);
+}
 
-    data = (*FEP_uart_getc)();
-    status = data >> 8;
-    data = (data & 0xff);
+uint8_t FEP_readConfig(void) {
+    return fep_readConfig(&FEP_default);
+}
 
-    return data;
+void FEP_beginConfig(void) {
+    fep_beginConfig(&FEP_default);
 }
 
-int FEP_io_putchar(char c, FILE *stream) {
-    (*FEP_uart_putc)(c);
-    return 0;
+uint8_t FEP_commitConfig(void) {
+    return fep_commitConfig(&FEP_default);
 }
 
-char *FEP_fgets(char * s, int n, FILE * stream) {
-    int i;
-    char *ret;
+uint32_t FEP_getBaud(void) {
+    return fep_getBaud(&FEP_default);
+}
 
-    cli();
-    if (FEP_available()) {
-        for (i = 0; i < FEP_LINE_LEN - 3 && !(FEP_latestPacket[i] == '\r' && FEP_latestPacket[i + 1] == '\n' && FEP_latestPacket[i + 2] == '\0'); i++) {
-            s[i] = FEP_latestPacket[i];
-        }
-        s[i] = '\r';
-        s[i + 1] = '\n';
-        s[i + 2] = '\0';
-        ret = s;
-        FEP_availableFlag = 0;
-    } else {
-        ret = NULL;
-    }
-    sei();
+uint8_t FEP_setBaud(uint32_t baud) {
+    return fep_setBaud(&FEP_default, baud);
+}
 
-    return ret;
+uint32_t FEP_detectBaud(void) {
+    return fep_detectBaud(&FEP_default);
 }
 
 uint16_t FEP_available(void) {
-	return FEP_availableFlag;
+    return fep_available(&FEP_default);
 }
 
-void FEP_rxHandler(uint8_t data, uint8_t error) {
-    static uint8_t FEP_lastRxData = '\0';
+uint16_t FEP_getRxOverflow(void) {
+    return fep_getRxOverflow(&FEP_default);
+}
+
+void FEP_getStats(fep_stats_t *stats) {
+    fep_getStats(&FEP_default, stats);
+}
 
-    if (FEP_lastRxData == '\r' && data == '\n') {
-        /* received terminator */
-        uint16_t status, data, i;
+void FEP_resetStats(void) {
+    fep_resetStats(&FEP_default);
+}
 
-        /* move data to buffer which stores a latest packet */
-        for (i = 0; i < FEP_LINE_LEN - 1 && (*FEP_uart_available)() > 0; i++) {
-            data = (*FEP_uart_getc)();
-            status = data >> 8;
-            data = (data & 0xff);
-            FEP_latestPacket[i] = data;
-        }
-        FEP_latestPacket[i] = '\0';
-        FEP_availableFlag = 1;
-    }
+void FEP_setSequence(uint8_t enable) {
+    fep_setSequence(&FEP_default, enable);
+}
 
-    FEP_lastRxData = data;
+uint8_t FEP_setPeerSequence(int16_t addr, uint8_t enable) {
+    return fep_setPeerSequence(&FEP_default, addr, enable);
+}
 
-    return;
+void FEP_rxHandler(uint8_t data, uint8_t error) {
+    FEP_rxDecode(&FEP_default, data, error);
 }
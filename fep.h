@@ -2,7 +2,11 @@
 #define _FEP_H
 
 #include <stdio.h>
+#include <stdint.h>
+#if !defined( FEP_HOST )
 #include "avr-uart/uart.h"
+#endif
+#include "fep_config.h"
 
 /*
 ** FEP responses
@@ -14,32 +18,367 @@
 #define FEP_N1  (0x14)  /* データ送信失敗(宛先の無線モデムの応答なし、キャリアセンスで送信出来なかった)  */
 #define FEP_N2  (0x15)  /* 割り当てなし */
 #define FEP_N3  (0x16)  /* データ送信失敗(宛先の無線モデムのバッファがフルで受信できない) */
+#define FEP_DROPPED (0x17) /* 送信キューで古くなったので送信せずに破棄した */
 
 #define FEP_DT_ERR 0
 #define FEP_DT_STR 1
 #define FEP_DT_BIN 2
+#define FEP_DT_LINE 3   /* other line from FEP */
+#define FEP_DT_ANY 4    /* fep_onReceive(): any packet (not FEP_DT_LINE) */
+
+#define FEP_MAX_DATA_LEN 256    /* maximum data length of a packet */
+#define FEP_REPLY_LEN 7         /* longest reply to a query command("1234H") + margin */
+#define FEP_REG_COUNT 32        /* number of registers (REG00~REG31) */
+#define FEP_REG_BAUD 20         /* register of the serial bit rate (see fep_setBaud()) */
+#define FEP_SEQ_LEN 1           /* sequence number added to every packet (see fep_setSequence()) */
+#define FEP_MAX_REPEATERS 2     /* repeaters a packet can go through (@TXR/@TX2) */
+#define FEP_BROADCAST 255       /* address received by all modems (no ACK) */
+#define FEP_ANY_ADDR (-1)       /* any transmitter (not an address) */
+#define FEP_KEEP 0xFF           /* fep_init(): address or band left as FEP has it */
+#define FEP_KEEP_ID 0xFFFF      /* fep_init(): ID left as FEP has it */
+#define FEP_REG_INTENSITY 13    /* register whose bit 7 adds the intensity to received packets */
+#if defined( FEP_NO_QUERY )
+#define FEP_REPLY_QUEUE_DEPTH 1 /* only the ping of fep_init() reads a setting */
+#else
+#define FEP_REPLY_QUEUE_DEPTH 4 /* replies to query commands buffered (power of two) */
+#endif
+
+/* bulk transfer (see fep_sendBulk()) */
+#define FEP_BULK_HEAD_LEN 5     /* header of a fragment */
+#define FEP_BULK_FRAG_LEN (FEP_MAX_PAYLOAD - FEP_SEQ_LEN - FEP_BULK_HEAD_LEN) /* data in a fragment */
+#define FEP_BULK_MAX_FRAGS 255
+#define FEP_BULK_MAX_LEN ((uint16_t)FEP_BULK_MAX_FRAGS * FEP_BULK_FRAG_LEN)
+
+#if FEP_MAX_PAYLOAD > FEP_MAX_DATA_LEN
+#error "FEP_MAX_PAYLOAD is larger than FEP can carry"
+#endif
+#if !defined( FEP_NO_BIN ) && FEP_MAX_PAYLOAD <= FEP_SEQ_LEN + FEP_BULK_HEAD_LEN
+#error "FEP_MAX_PAYLOAD leaves no room for data in a bulk fragment"
+#endif
+
+/* priorities of the asynchronous send queue (see fep_putsAsyncPrio()) */
+#define FEP_PRIO_URGENT 0                           /* sent first */
+#define FEP_PRIO_NORMAL (FEP_TX_PRIORITIES - 1)     /* fep_putsAsync(), fep_putbinAsync() */
+
+/* results of fep_bulkFeed() */
+#define FEP_BULK_NONE 0         /* the frame isn't a part of bulk transfer */
+#define FEP_BULK_MORE 1         /* the frame has been used, waiting more */
+#define FEP_BULK_DONE 2         /* all data has been received */
+#define FEP_BULK_ERROR 3        /* the data doesn't fit the buffer */
+
+/*
+ * types
+ */
+/* repeaters between two modems, in the order the packet goes through them */
+typedef struct {
+    uint8_t hops;       /* number of repeaters (0: direct) */
+    uint8_t via[FEP_MAX_REPEATERS];
+} fep_route_t;
+
+/* received frame decoded by fep_rxHandler() */
+typedef struct {
+    uint8_t type;       /* FEP_DT_STR, FEP_DT_BIN or FEP_DT_LINE */
+    uint8_t addr;       /* transmitter's address */
+    uint16_t len;       /* length of data */
+    int16_t intensity;  /* electric field intensity (of the last hop if relayed) */
+    fep_route_t route;  /* repeaters from the transmitter (RXR, RBR, RX2, RB2) */
+    char data[FEP_MAX_PAYLOAD + 3 + 1]; /* data(+intensity while decoding a string)+null character */
+} fep_frame_t;
+
+/* called by the transport for every byte received from FEP */
+typedef void (*fep_rxhandler_t)(void *arg, uint8_t data, uint8_t error);
+
+/* serial port connected to FEP.
+ * FEP_init() uses the avr-uart module. Other transports (e.g. the simulator
+ * of the host build) can be given to FEP_initTransport(). */
+typedef struct {
+    /* open the port with the bit rate [bps] */
+    void (*init)(void *ctx, uint32_t baud);
+    /* register the function called for every received byte (in interrupt) */
+    void (*setRxHandler)(void *ctx, fep_rxhandler_t handler, void *arg);
+    /* send bytes */
+    void (*write)(void *ctx, const uint8_t *buf, uint16_t len);
+    void *ctx;
+} fep_transport_t;
+
+/* called by fep_poll() when an asynchronous sending has finished.
+ * response is the final response from FEP (FEP_P0 on success), or
+ * FEP_DROPPED if the packet became stale in the queue. */
+typedef void (*fep_callback_t)(uint8_t response, void *arg);
+
+/* called by fep_poll() for a received frame (see fep_onReceive()). The
+ * frame is released when it returns. */
+typedef void (*fep_handler_t)(const fep_frame_t *frame, void *arg);
+
+/* entry of the handler table */
+typedef struct {
+    fep_handler_t fn;   /* NULL: unused entry */
+    void *arg;
+    int16_t addr;       /* transmitter's address, or FEP_ANY_ADDR */
+    uint8_t type;       /* FEP_DT_STR, FEP_DT_BIN, FEP_DT_LINE or FEP_DT_ANY */
+} fep_dispatch_t;
+
+/* packet queued by fep_putsAsync() or fep_putbinAsync() */
+typedef struct {
+    const char *data;
+    uint16_t len;
+    uint8_t type;
+    uint8_t addr;
+    uint8_t seq;        /* sequence number (see fep_setSequence()) */
+    uint8_t retry;      /* tries which have failed */
+    uint32_t queuedAt;  /* time it was queued [ms] */
+    fep_callback_t cb;
+    void *arg;
+} fep_txpacket_t;
+
+/* receiving side of a bulk transfer (see fep_bulkInit()) */
+typedef struct {
+    char *buf;
+    uint16_t size;      /* size of buf */
+    uint16_t len;       /* length of the received data */
+    uint8_t addr;       /* sender's address */
+    uint8_t id;         /* number of the transfer */
+    uint8_t count;      /* number of fragments (0: nothing received) */
+    uint8_t state;      /* FEP_BULK_MORE, FEP_BULK_DONE or FEP_BULK_ERROR */
+    uint8_t received[(FEP_BULK_MAX_FRAGS + 7) / 8]; /* bit n: fragment n has arrived */
+} fep_bulk_t;
+
+/* small messages packed into one packet (see fep_batchInit()) */
+typedef struct {
+    uint8_t addr;       /* receiver's address */
+    uint8_t count;      /* number of messages */
+    uint16_t len;       /* bytes used in buf */
+    uint16_t delay;     /* longest wait of a message [ms] */
+    uint32_t since;     /* time of the first message [ms] */
+    char buf[FEP_MAX_PAYLOAD];
+} fep_batch_t;
+
+/* settings of a profile other than whole registers (fep_profile_t.set) */
+#define FEP_PROFILE_FRQ(ch) (1 << ((ch) - 1))   /* band of channel 1~3 */
+#define FEP_PROFILE_ID (1 << 3)
+#define FEP_PROFILE_INTENSITY (1 << 4)  /* bit 7 of FEP_REG_INTENSITY only */
+
+/* settings of FEP applied by fep_initProfile() and fep_applyProfile().
+ * Only what regMask and set select is read and written.
+ * Can be kept in PROGMEM or EEPROM and copied to SRAM before use. */
+typedef struct {
+    uint32_t regMask;   /* bit n: reg[n] is set */
+    uint8_t reg[FEP_REG_COUNT];
+    uint8_t set;        /* FEP_PROFILE_xxx: the other settings which are set */
+    uint8_t frq[3];     /* bands of channel 1~3 */
+    uint16_t id;
+} fep_profile_t;
+
+/* counters of a module (see fep_getStats()). Every counter saturates at
+ * 0xFFFF. */
+typedef struct {
+    uint16_t sentStr;       /* @TXT sent, including retries */
+    uint16_t sentBin;       /* @TBN sent, including retries */
+    uint16_t recvStr;       /* RXT put to the receive queue */
+    uint16_t recvBin;       /* RBN put to the receive queue */
+    uint16_t response[6];   /* responses from FEP: [0] P0, [1] P1, [2] N0 ~ [5] N3 */
+    uint16_t timeouts;      /* commands FEP didn't answer in time */
+    uint16_t retries;       /* packets sent again */
+    uint16_t tries[FEP_STATS_TRY_BINS]; /* packets by the number of tries */
+    uint16_t rxDropped;     /* frames dropped because the receive queue was full */
+    uint16_t txStale;       /* asynchronous packets dropped because they became stale */
+    uint16_t duplicates;    /* packets dropped because they were received twice */
+    uint16_t parseErrors;   /* broken lines from FEP (UART error, bad header, too long) */
+    uint16_t isrMax;        /* longest run of the rx handler [ticks of FEP_STATS_CLOCK()] */
+    uint16_t intensity[FEP_STATS_INTENSITY_BINS]; /* packets by intensity */
+} fep_stats_t;
+
+/* quality of the link to a peer (see fep_getLink()) */
+typedef struct {
+    uint8_t addr;
+    int16_t intensity;  /* smoothed intensity of the packets from the peer, or -1 */
+    uint16_t delivery;  /* smoothed ratio of the tries to the peer that got P0
+                         * rather than N1 [permille], or 0xFFFF if none */
+    uint16_t rtt;       /* smoothed round trip time [ms], or 0 if unknown */
+    uint32_t age;       /* time since the last packet from the peer [ms],
+                         * or 0xFFFFFFFF if none */
+} fep_link_t;
+
+/* entry of the peer table */
+typedef struct {
+    uint8_t addr;
+    uint8_t known;      /* which values are known, 0: unused entry */
+    int16_t srtt;       /* smoothed round trip time [ms / 8] */
+    int16_t rttvar;     /* mean deviation of round trip time [ms / 4] */
+    int16_t intensity;  /* smoothed intensity [1 / 8] */
+    uint16_t delivery;  /* smoothed ratio of P0 to P0 and N1 [1 / 65535] */
+    uint32_t seen;      /* time of the last packet from the peer [ms] */
+    uint32_t at;        /* time of the last packet from or to the peer [ms] */
+    fep_route_t route;  /* repeaters which reach the peer (see fep_setRoute()) */
+    uint8_t relay;      /* packets to the peer go through route */
+    uint8_t probe;      /* relayed packets since the direct link was tried */
+} fep_peer_t;
+
+/* sequence numbers received from a transmitter */
+typedef struct {
+    uint8_t addr;
+    uint8_t used;
+    uint8_t last;       /* newest sequence number */
+    uint16_t window;    /* bit n: (last - n) has been received */
+    uint32_t at;        /* time of the last packet [ms] */
+} fep_seqwin_t;
+
+/* A FEP module. Declare one as a global or static variable for every module
+ * connected to the MCU and pass it to the fep_xxx() functions.
+ * The members are private.
+ * Each module costs about FEP_RX_QUEUE_DEPTH * (FEP_MAX_PAYLOAD + 13) + 290
+ * bytes of SRAM,
+ * FEP_TX_PRIORITIES * FEP_TX_QUEUE_DEPTH * 16 bytes for the send queue
+ * (58 more with FEP_STATS). */
+typedef struct {
+    /* state of the receive parser (used only in the rx handler).
+     * The members used in the interrupt come first, so that AVR can
+     * reach them with a short displacement from the pointer. */
+    struct {
+        uint8_t state;
+        uint8_t type;       /* FEP_DT_xxx of the line */
+        uint8_t drop;       /* the receive queue is full */
+        uint8_t digits;     /* number of digits received in the current field */
+        uint8_t hops;       /* repeater addresses in the header */
+        uint8_t addrs;      /* address fields received */
+        uint16_t value;     /* value of the current numeric field */
+        uint16_t pos;       /* number of characters in the current line */
+        uint16_t remain;    /* remaining binary bytes */
+        char head[FEP_REPLY_LEN]; /* beginning of the line */
+    } rx;
+    /* single-producer(rx handler)/single-consumer(fep_gets) frame queue.
+     * rxHead is written only by the producer and rxTail only by the
+     * consumer, except that with FEP_RX_DROP_OLDEST the producer advances
+     * rxTail while rxHeld is 0. Both are free-running, so (head - tail) is
+     * the number of frames. */
+    volatile uint8_t rxHead;
+    volatile uint8_t rxTail;
+    volatile uint16_t rxOverflow;
+    volatile uint8_t rxAccounted;   /* the frame at rxTail is in the peer table */
+#if defined( FEP_RX_DROP_OLDEST )
+    volatile uint8_t rxHeld;    /* the reader is using the frames from rxTail */
+#endif
+    /* mailboxes for the command waiting a response or a reply */
+    volatile uint8_t response;
+    volatile uint8_t replyHead;
+    volatile uint8_t replyTail;
+    volatile char reply[FEP_REPLY_QUEUE_DEPTH][FEP_REPLY_LEN + 1];
+    volatile int16_t intensity;
+    volatile uint8_t transmitterAddr;
+    /* sequence numbers of packets (see fep_setSequence()). seqWin is
+     * used only in the rx handler. */
+    uint8_t seqOn;
+    uint8_t txSeq;      /* sequence number of the next packet */
+    uint8_t seqFrom[256 / 8]; /* bit per transmitter: its packets have them */
+    fep_seqwin_t seqWin[FEP_SEQ_TABLE_SIZE];
+    const fep_transport_t *transport;
+    uint32_t baud;      /* bit rate between MCU and FEP */
+    uint16_t bootMs;    /* time fep_init() took [ms] */
+    /* queues of asynchronous packets, one for every priority (used only
+     * in the main loop) */
+    uint8_t txHead[FEP_TX_PRIORITIES];
+    uint8_t txTail[FEP_TX_PRIORITIES];
+    uint8_t txLimit[FEP_TX_PRIORITIES];     /* packets allowed in the queue */
+    uint16_t txMaxAge[FEP_TX_PRIORITIES];   /* age of a stale packet [ms], 0: none */
+    struct {
+        uint8_t state;
+        uint8_t prio;       /* queue of the packet being sent */
+        uint8_t timedOut;   /* the previous try got no response */
+        uint8_t relayed;    /* the current try goes through repeaters */
+        uint32_t sentAt;
+        uint32_t deadline;
+    } tx;
+    fep_txpacket_t txQueue[FEP_TX_PRIORITIES][FEP_TX_QUEUE_DEPTH];
+    /* time slots (see fep_tdmaStart()). The members from slots on are
+     * written by the rx handler when a node receives a beacon. */
+    struct {
+        uint8_t role;               /* off, node or coordinator */
+        uint8_t slot;               /* own slot */
+        volatile uint8_t slots;     /* slots in a frame, 0: no beacon yet */
+        volatile uint16_t slotMs;
+        volatile uint32_t beaconAt; /* time the last beacon ended [ms] */
+    } tdma;
+    /* link quality and round trip time of the recent peers (used only in
+     * the main loop) */
+    fep_peer_t peer[FEP_PEER_TABLE_SIZE];
+    /* handlers of received frames (used only in the main loop) */
+    fep_dispatch_t handler[FEP_HANDLERS];
+    uint8_t dispatching;    /* fep_poll() is calling a handler */
+    uint8_t bulkId;     /* number of the last bulk transfer sent */
+    /* copy of the settings of FEP (see fep_beginConfig()) */
+    struct {
+        uint8_t reg[FEP_REG_COUNT];
+        uint8_t frq[3];
+        uint16_t id;
+        uint32_t regValid;  /* bit n: reg[n] is known */
+        uint32_t regDirty;  /* bit n: reg[n] is changed and not written yet */
+        uint8_t valid;      /* FEP_CFG_xxx: frq[] and id are known */
+        uint8_t dirty;      /* FEP_CFG_xxx: frq[] and id are changed */
+        uint8_t open;       /* between fep_beginConfig() and fep_commitConfig() */
+    } cfg;
+#if defined( FEP_STATS )
+    fep_stats_t stats;  /* written by the rx handler and the main loop */
+#endif
+#if defined( FEP_HOST )
+    FILE *stream;
+#else
+    FILE stream;
+#endif
+    volatile fep_frame_t rxQueue[FEP_RX_QUEUE_DEPTH];
+} fep_t;
+
+/* streams of packets to and from a peer (see fep_pipeOpen()). Declare one
+ * as a global or static variable for every peer. */
+typedef struct {
+    fep_t *fep;
+    uint8_t addr;       /* peer's address */
+    uint8_t response;   /* response to the last packet sent */
+    uint16_t len;       /* bytes waiting in buf */
+    uint16_t pos;       /* bytes read from the frame at the head of the receive queue */
+    char buf[FEP_MAX_PAYLOAD];
+#if defined( FEP_HOST )
+    FILE *out;
+    FILE *in;
+#else
+    FILE out;
+    FILE in;
+#endif
+} fep_pipe_t;
 
 /*
  * global variables
  */
-extern FILE fepio;
+/* module used by the FEP_xxx() functions (see FEP_init()) */
+extern fep_t FEP_default;
+
+/* stream connected to the module of FEP_init() */
+#if defined( FEP_HOST )
+#define fepio (*fep_stream(&FEP_default))
+#else
+#define fepio (FEP_default.stream)
+#endif
 
 /*
 ** function prototypes
 */
 
 /******************************************************************************
-Function: FEP_init()
-Purpose:  Initializing UART and FEP.
-Params:   module - UART module's number (0~3)
-          addr - address of FEP
-          ch1 - channel1 band of FEP
-          ch2 - channel2 band of FEP
-          ch3 - channel3 band of FEP
-          id - id of FEP
+Function: fep_init()
+Purpose:  Initializing UART and FEP. Every module needs its own UART.
+          The settings are applied by fep_initProfile(), so only the ones
+          which differ from FEP are written, and FEP isn't reset when all
+          of them already match.
+Params:   fep - module
+          module - UART module's number (0~3)
+          addr - address of FEP (FEP_KEEP: leave it unchanged)
+          ch1 - channel1 band of FEP (FEP_KEEP: leave it unchanged)
+          ch2 - channel2 band of FEP (FEP_KEEP: leave it unchanged)
+          ch3 - channel3 band of FEP (FEP_KEEP: leave it unchanged)
+          id - id of FEP (FEP_KEEP_ID: leave it unchanged)
 Return:   none
 ******************************************************************************/
-void FEP_init(
+void fep_init(
+    fep_t *fep,
     uint8_t module,
     uint8_t addr,
     uint8_t ch1,
@@ -49,151 +388,950 @@ void FEP_init(
     );
 
 /******************************************************************************
-Function: FEP_puts()
-Purpose:  Sending string.
-Params:   str - string for sending
+Function: fep_initTransport()
+Purpose:  Initializing FEP connected to the given transport.
+Params:   fep - module
+          transport - serial port connected to FEP
+          addr - address of FEP (FEP_KEEP: leave it unchanged)
+          ch1 - channel1 band of FEP (FEP_KEEP: leave it unchanged)
+          ch2 - channel2 band of FEP (FEP_KEEP: leave it unchanged)
+          ch3 - channel3 band of FEP (FEP_KEEP: leave it unchanged)
+          id - id of FEP (FEP_KEEP_ID: leave it unchanged)
+Return:   none
+******************************************************************************/
+void fep_initTransport(
+    fep_t *fep,
+    const fep_transport_t *transport,
+    uint8_t addr,
+    uint8_t ch1,
+    uint8_t ch2,
+    uint8_t ch3,
+    uint16_t id
+    );
+
+/******************************************************************************
+Function: fep_initProfile()
+Purpose:  Initializing FEP connected to the given transport with a profile.
+          FEP is asked until it answers instead of waiting for the longest
+          start time, then the profile is applied with fep_applyProfile().
+          Calling it again with the same profile writes nothing.
+Params:   fep - module
+          transport - serial port connected to FEP (fep_uart() for UART)
+          profile - settings of FEP
+Return:   FEP_P0, FEP_NO_RESPONSE if FEP doesn't answer at any bit rate, or
+          the response from FEP if a setting failed
+******************************************************************************/
+uint8_t fep_initProfile(fep_t *fep, const fep_transport_t *transport, const fep_profile_t *profile);
+
+/******************************************************************************
+Function: fep_uart()
+Purpose:  get the transport of a UART module
+Params:   module - UART module's number (0~3)
+Return:   transport, or NULL if the module isn't enabled in avr-uart (or
+          isn't FEP_UART_MODULE when it is defined)
+******************************************************************************/
+const fep_transport_t *fep_uart(uint8_t module);
+
+/******************************************************************************
+Function: fep_profileInit()
+Purpose:  Make a profile with the settings fep_init() applies: address,
+          bands and ID except the ones given as FEP_KEEP(_ID), and the bit
+          adding electric field intensity to received packets (the other
+          bits of FEP_REG_INTENSITY are kept). More registers can be added
+          by setting reg[] and regMask.
+Params:   profile - profile
+          addr - address of FEP (FEP_KEEP: leave it unchanged)
+          ch1 - channel1 band of FEP (FEP_KEEP: leave it unchanged)
+          ch2 - channel2 band of FEP (FEP_KEEP: leave it unchanged)
+          ch3 - channel3 band of FEP (FEP_KEEP: leave it unchanged)
+          id - id of FEP (FEP_KEEP_ID: leave it unchanged)
+Return:   none
+******************************************************************************/
+void fep_profileInit(fep_profile_t *profile, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id);
+
+/******************************************************************************
+Function: fep_applyProfile()
+Purpose:  Read the settings of the profile from FEP, and write only the
+          ones which differ. FEP is reset once if a register is written.
+          With FEP_NO_QUERY nothing can be read, so every selected setting
+          is written (FEP_PROFILE_INTENSITY as the whole register).
+Params:   fep - module
+          profile - settings of FEP
+Return:   FEP_P0, or the response from FEP if reading or writing failed
+******************************************************************************/
+uint8_t fep_applyProfile(fep_t *fep, const fep_profile_t *profile);
+
+/******************************************************************************
+Function: fep_getBootTime()
+Purpose:  get the time from the beginning of the last fep_init() until FEP
+          answered and the profile was applied.
+Params:   fep - module
+Return:   time [ms]
+******************************************************************************/
+uint16_t fep_getBootTime(fep_t *fep);
+
+#if !defined( FEP_NO_STR )
+/******************************************************************************
+Function: fep_puts()
+Purpose:  Sending string. Each try waits for the time estimated from the
+          round trip times to the receiver. After a failure, it waits for a
+          random time which doubles at every try, and tries again up to
+          10 times. If repeaters which reach the receiver are known (see
+          fep_setRoute()), a try which gets N1 is followed by a try on the
+          other path, direct or through the repeaters.
+Params:   fep - module
+          str - string for sending
           addr - receiver's address
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_puts(char *str, uint8_t addr);
+uint8_t fep_puts(fep_t *fep, char *str, uint8_t addr);
+#endif
 
+#if !defined( FEP_NO_BIN )
 /******************************************************************************
-Function: FEP_putbin()
-Purpose:  Sending binary array.
-Params:   ary - head address of array
+Function: fep_putbin()
+Purpose:  Sending binary array. Retried like fep_puts().
+Params:   fep - module
+          ary - head address of array
           len - size of array
           addr - receiver's address
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_putbin(char *ary, size_t len, uint8_t addr);
+uint8_t fep_putbin(fep_t *fep, char *ary, size_t len, uint8_t addr);
+#endif
+
+#if !defined( FEP_NO_STR )
+/******************************************************************************
+Function: fep_putsTimeout()
+Purpose:  Sending string like fep_puts() within the given time.
+Params:   fep - module
+          str - string for sending
+          addr - receiver's address
+          timeout - time for sending and retries [ms] (0: no limit)
+Return:   response from FEP (FEP_NO_RESPONSE if the time is up before
+          any response)
+******************************************************************************/
+uint8_t fep_putsTimeout(fep_t *fep, char *str, uint8_t addr, uint16_t timeout);
+#endif
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: fep_putbinTimeout()
+Purpose:  Sending binary array like fep_putbin() within the given time.
+Params:   fep - module
+          ary - head address of array
+          len - size of array
+          addr - receiver's address
+          timeout - time for sending and retries [ms] (0: no limit)
+Return:   response from FEP (FEP_NO_RESPONSE if the time is up before
+          any response)
+******************************************************************************/
+uint8_t fep_putbinTimeout(fep_t *fep, char *ary, size_t len, uint8_t addr, uint16_t timeout);
+#endif
+
+#if !defined( FEP_NO_STR )
+/******************************************************************************
+Function: fep_putsVia()
+Purpose:  Sending string through the given repeaters (@TXR, @TX2), retried
+          like fep_puts(). The receiver gets it as RXR or RX2.
+Params:   fep - module
+          str - string for sending
+          addr - receiver's address
+          route - repeaters (hops 0: direct)
+Return:   response from FEP (FEP_N0 if route has more than
+          FEP_MAX_REPEATERS repeaters)
+******************************************************************************/
+uint8_t fep_putsVia(fep_t *fep, char *str, uint8_t addr, const fep_route_t *route);
+#endif
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: fep_putbinVia()
+Purpose:  Sending binary array through the given repeaters (@TBR, @TB2),
+          retried like fep_puts(). The receiver gets it as RBR or RB2.
+Params:   fep - module
+          ary - head address of array
+          len - size of array
+          addr - receiver's address
+          route - repeaters (hops 0: direct)
+Return:   response from FEP (FEP_N0 if route has more than
+          FEP_MAX_REPEATERS repeaters)
+******************************************************************************/
+uint8_t fep_putbinVia(fep_t *fep, char *ary, size_t len, uint8_t addr, const fep_route_t *route);
+#endif
+
+/******************************************************************************
+Function: fep_setRoute()
+Purpose:  Set the repeaters which reach a peer. A route is also learned
+          from every relayed packet received, by reversing its repeaters.
+          While the direct link fails (N1), the packets to the peer go
+          through the repeaters, and every 16th of them tries the direct
+          link first.
+Params:   fep - module
+          addr - address of the peer
+          route - repeaters (NULL or hops 0: forget the route)
+Return:   response (FEP_P0, or FEP_N0 if route has more than
+          FEP_MAX_REPEATERS repeaters)
+******************************************************************************/
+uint8_t fep_setRoute(fep_t *fep, uint8_t addr, const fep_route_t *route);
+
+/******************************************************************************
+Function: fep_getRoute()
+Purpose:  get the path the next packet to a peer takes
+Params:   fep - module
+          addr - address of the peer
+          route - variable for storing the repeaters (hops 0: direct)
+Return:   1 if repeaters which reach the peer are known, otherwise 0
+******************************************************************************/
+uint8_t fep_getRoute(fep_t *fep, uint8_t addr, fep_route_t *route);
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: fep_sendBulk()
+Purpose:  Send data longer than a packet (up to FEP_BULK_MAX_LEN bytes).
+          The data is split to numbered fragments, which are sent in
+          windows of FEP_BULK_WINDOW. Every fragment is tried once, and the
+          receiver answers the last one of a window with the fragments
+          which have arrived. The failed and the missing fragments are sent
+          in the next window. The receiver must call fep_recvBulk() or
+          fep_bulkFeed().
+Params:   fep - module
+          data - data for sending
+          len - size of data
+          addr - receiver's address
+Return:   FEP_P0 if the receiver has got all data, FEP_N0 if the data is
+          too long, or the last failed response when FEP_RETRY fragments in
+          a row or windows without progress have failed
+******************************************************************************/
+uint8_t fep_sendBulk(fep_t *fep, const char *data, uint16_t len, uint8_t addr);
+
+/******************************************************************************
+Function: fep_bulkInit()
+Purpose:  Prepare to receive a bulk transfer into the buffer
+Params:   bulk - receiving state
+          buf - buffer for storing the data
+          size - size of buf
+Return:   none
+******************************************************************************/
+void fep_bulkInit(fep_bulk_t *bulk, char *buf, uint16_t size);
+
+/******************************************************************************
+Function: fep_bulkFeed()
+Purpose:  Pass a received frame to the bulk transfer. Fragments are copied
+          to the buffer, and the last fragment of a window is answered with
+          the fragments which have arrived.
+          Call this function for every frame got by fep_recvFrame() until
+          it returns FEP_BULK_DONE. A new transfer from another sender or
+          with another number starts over.
+Params:   fep - module which has received the frame
+          bulk - receiving state
+          frame - frame got by fep_recvFrame()
+Return:   FEP_BULK_NONE if the frame isn't a part of bulk transfer (it is
+          yours), otherwise FEP_BULK_MORE, FEP_BULK_DONE or FEP_BULK_ERROR
+******************************************************************************/
+uint8_t fep_bulkFeed(fep_t *fep, fep_bulk_t *bulk, const fep_frame_t *frame);
+
+/******************************************************************************
+Function: fep_recvBulk()
+Purpose:  Receive a bulk transfer with fep_bulkFeed(). Other frames
+          received meanwhile are discarded.
+Params:   fep - module
+          bulk - receiving state initialized by fep_bulkInit()
+          timeout - time to wait for the next frame [ms]
+Return:   FEP_BULK_DONE, FEP_BULK_ERROR, or FEP_BULK_MORE if timed out.
+          The data is bulk->buf and its length is bulk->len.
+******************************************************************************/
+uint8_t fep_recvBulk(fep_t *fep, fep_bulk_t *bulk, uint16_t timeout);
+
+/******************************************************************************
+Function: fep_batchInit()
+Purpose:  Prepare to pack small messages into packets. A packet is sent
+          when the next message doesn't fit, goes to another address, or
+          delay has passed since the first message (see fep_batchPoll()).
+          Each message costs one byte more than its length, and the
+          packet one byte. The receiver splits the packet with
+          fep_batchNext().
+Params:   batch - packing state
+          delay - longest wait of a message [ms] (0: until the packet is
+                  full or fep_batchFlush())
+Return:   none
+******************************************************************************/
+void fep_batchInit(fep_batch_t *batch, uint16_t delay);
+
+/******************************************************************************
+Function: fep_batchPut()
+Purpose:  Add a message to the batch. The packet of the messages before is
+          sent first (like fep_putbin()) if needed.
+Params:   fep - module
+          batch - packing state
+          msg - message
+          len - size of message (up to FEP_MAX_PAYLOAD - FEP_SEQ_LEN - 2)
+          addr - receiver's address
+Return:   FEP_P1 if the message has been added, FEP_N0 if it is too long
+          or the batch has a delay and FEP_tick() isn't running, or the
+          failed response of sending the packet before (the message isn't
+          added then)
+******************************************************************************/
+uint8_t fep_batchPut(fep_t *fep, fep_batch_t *batch, const char *msg, uint8_t len, uint8_t addr);
+
+/******************************************************************************
+Function: fep_batchFlush()
+Purpose:  Send the messages in the batch now
+Params:   fep - module
+          batch - packing state
+Return:   response from FEP (FEP_P0 if the batch is empty). The messages are
+          discarded even if sending has failed.
+******************************************************************************/
+uint8_t fep_batchFlush(fep_t *fep, fep_batch_t *batch);
+
+/******************************************************************************
+Function: fep_batchPoll()
+Purpose:  Send the messages in the batch if the first one has waited delay.
+          Call it from the main loop. FEP_tick() must be called every 1 ms.
+Params:   fep - module
+          batch - packing state
+Return:   response from FEP, or FEP_P1 if nothing has been sent
+******************************************************************************/
+uint8_t fep_batchPoll(fep_t *fep, fep_batch_t *batch);
+
+/******************************************************************************
+Function: fep_batchNext()
+Purpose:  Take the next message from a packet sent by fep_batchPut()
+Params:   frame - frame got by fep_recvFrame()
+          pos - position in the frame (set 0 before the first call)
+          msg - variable for storing the head of the message
+          len - variable for storing the size of the message
+Return:   1 if a message has been taken, 0 at the end. If the frame isn't
+          a batch, 0 is returned with *pos still 0.
+******************************************************************************/
+uint8_t fep_batchNext(const fep_frame_t *frame, uint16_t *pos, const char **msg, uint8_t *len);
+
+/******************************************************************************
+Function: fep_pipeOpen()
+Purpose:  Set up the streams of packets to and from a peer. What is written
+          to fep_pipeOut() is buffered and sent as one binary packet (like
+          fep_putbin()) when the packet is full, at a newline, or by
+          fep_pipeFlush(), so that a line of fprintf()s costs one packet.
+          fep_pipeIn() reads the data of the packets received from the
+          peer. Don't write to fep_stream() between the packets.
+Params:   fep - module
+          pipe - state of the streams
+          addr - peer's address (FEP_BROADCAST: send to all, and read the
+                 packets from anyone)
+Return:   none
+******************************************************************************/
+void fep_pipeOpen(fep_t *fep, fep_pipe_t *pipe, uint8_t addr);
+
+/******************************************************************************
+Function: fep_pipeOut()
+Purpose:  get the stream which sends packets to the peer. A write fails
+          (ferror()) if the packet it completes isn't delivered; the packet
+          is dropped then.
+Params:   pipe - state of the streams
+Return:   stream
+******************************************************************************/
+FILE *fep_pipeOut(fep_pipe_t *pipe);
+
+/******************************************************************************
+Function: fep_pipeIn()
+Purpose:  Get the stream which reads the packets received from the peer.
+          It doesn't wait: it reads EOF while the frame at the head of the
+          receive queue is from another modem or nothing has arrived, and
+          clearerr() must be called before reading again. Lines from FEP
+          which aren't packets are skipped. Don't take frames with
+          fep_gets() or fep_recvFrame() while a packet is half read.
+Params:   pipe - state of the streams
+Return:   stream
+******************************************************************************/
+FILE *fep_pipeIn(fep_pipe_t *pipe);
+
+/******************************************************************************
+Function: fep_pipeFlush()
+Purpose:  Send what is buffered in fep_pipeOut(). On the host build,
+          fflush() does the same; avr-libc's fflush() doesn't call the
+          stream, so use this on AVR.
+Params:   pipe - state of the streams
+Return:   response to the packet (FEP_P0 if nothing was buffered)
+******************************************************************************/
+uint8_t fep_pipeFlush(fep_pipe_t *pipe);
+#endif
+
+#if !defined( FEP_NO_STR )
+/******************************************************************************
+Function: fep_putsAsync()
+Purpose:  Queue a string for sending and return immediately.
+          The packet is sent and retried by fep_poll(). str must not be
+          changed until cb is called.
+Params:   fep - module
+          str - string for sending
+          addr - receiver's address
+          cb - function called with the final response (can be NULL)
+          arg - argument passed to cb
+Return:   FEP_P1 if queued, FEP_N3 if the queue is full,
+          FEP_N0 if the string is too long or FEP_tick() isn't running
+******************************************************************************/
+uint8_t fep_putsAsync(fep_t *fep, const char *str, uint8_t addr, fep_callback_t cb, void *arg);
+#endif
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: fep_putbinAsync()
+Purpose:  Queue a binary array for sending and return immediately.
+          The packet is sent and retried by fep_poll(). ary must not be
+          changed until cb is called.
+Params:   fep - module
+          ary - head address of array
+          len - size of array
+          addr - receiver's address
+          cb - function called with the final response (can be NULL)
+          arg - argument passed to cb
+Return:   FEP_P1 if queued, FEP_N3 if the queue is full,
+          FEP_N0 if the array is too long or FEP_tick() isn't running
+******************************************************************************/
+uint8_t fep_putbinAsync(fep_t *fep, const char *ary, size_t len, uint8_t addr, fep_callback_t cb, void *arg);
+#endif
+
+#if !defined( FEP_NO_STR )
+/******************************************************************************
+Function: fep_putsAsyncPrio()
+Purpose:  Queue a string for sending at a priority and return immediately.
+          fep_poll() sends the packets of the highest priority first. A
+          packet waiting to be tried again gives way to a packet of a
+          higher priority, so that it waits at most for one try in flight.
+          fep_putsAsync() queues at FEP_PRIO_NORMAL.
+Params:   fep - module
+          str - string for sending
+          addr - receiver's address
+          prio - priority, FEP_PRIO_URGENT(0, highest) ~ FEP_PRIO_NORMAL
+          cb - function called with the final response (can be NULL)
+          arg - argument passed to cb
+Return:   FEP_P1 if queued, FEP_N3 if the queue of the priority is full,
+          FEP_N0 if the string is too long, prio is wrong or FEP_tick()
+          isn't running
+******************************************************************************/
+uint8_t fep_putsAsyncPrio(fep_t *fep, const char *str, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg);
+#endif
+
+#if !defined( FEP_NO_BIN )
+/******************************************************************************
+Function: fep_putbinAsyncPrio()
+Purpose:  Queue a binary array for sending at a priority and return
+          immediately (see fep_putsAsyncPrio()).
+Params:   fep - module
+          ary - head address of array
+          len - size of array
+          addr - receiver's address
+          prio - priority, FEP_PRIO_URGENT(0, highest) ~ FEP_PRIO_NORMAL
+          cb - function called with the final response (can be NULL)
+          arg - argument passed to cb
+Return:   FEP_P1 if queued, FEP_N3 if the queue of the priority is full,
+          FEP_N0 if the array is too long, prio is wrong or FEP_tick()
+          isn't running
+******************************************************************************/
+uint8_t fep_putbinAsyncPrio(fep_t *fep, const char *ary, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg);
+#endif
+
+/******************************************************************************
+Function: fep_setTxQueue()
+Purpose:  Limit the queue of a priority. Packets older than maxAge which
+          haven't been sent successfully are dropped by fep_poll() and
+          their callbacks get FEP_DROPPED, e.g. for telemetry which is
+          replaced by newer values anyway.
+Params:   fep - module
+          prio - priority
+          depth - packets allowed in the queue (1 ~ FEP_TX_QUEUE_DEPTH,
+                  FEP_TX_QUEUE_DEPTH after fep_init())
+          maxAge - age of a stale packet [ms] (0: never, after fep_init())
+Return:   FEP_P0, or FEP_N0 if prio or depth is wrong
+******************************************************************************/
+uint8_t fep_setTxQueue(fep_t *fep, uint8_t prio, uint8_t depth, uint16_t maxAge);
+
+/******************************************************************************
+Function: fep_poll()
+Purpose:  Progress the asynchronous sending. Sends the next queued packet
+          of the highest priority, handles the response and retries with
+          the same timeouts and backoff as fep_puts(), drops stale packets
+          (see fep_setTxQueue()), and calls the callback when the packet
+          has finished. Then it passes the received frames to their
+          handlers (see fep_onReceive()). Call this function in the main
+          loop. The blocking send functions don't call the handlers, so a
+          handler can send, and the frames received meanwhile wait in the
+          receive queue.
+          Timeouts are measured by FEP_tick().
+Params:   fep - module
+Return:   none
+******************************************************************************/
+void fep_poll(fep_t *fep);
+
+/******************************************************************************
+Function: fep_txPending()
+Purpose:  get the number of asynchronous packets not finished yet
+Params:   fep - module
+Return:   number of packets in the send queues (including the one being sent)
+******************************************************************************/
+uint8_t fep_txPending(fep_t *fep);
+
+/******************************************************************************
+Function: fep_onReceive()
+Purpose:  Register the function fep_poll() calls for the frames of a
+          transmitter and a type. The most specific handler is called: an
+          address before FEP_ANY_ADDR, then a type before FEP_DT_ANY. Lines
+          from FEP which aren't packets (FEP_DT_LINE) go only to a handler
+          of FEP_ANY_ADDR and FEP_DT_LINE, and are skipped without one. A
+          packet without a handler is left in its place for fep_gets(),
+          and the frames behind it still go to their handlers. A handler
+          must not take frames from the receive queue itself (fep_gets(),
+          fep_recvFrame()). Register after fep_init(), which clears the
+          handlers.
+Params:   fep - module
+          addr - transmitter's address (0-255), or FEP_ANY_ADDR
+          type - FEP_DT_STR, FEP_DT_BIN, FEP_DT_LINE or FEP_DT_ANY
+          handler - function called with the frame (NULL: remove the handler
+                    of addr and type)
+          arg - argument passed to handler
+Return:   FEP_P0, FEP_N3 if FEP_HANDLERS handlers are registered already, or
+          FEP_N0 if addr or type is wrong
+******************************************************************************/
+uint8_t fep_onReceive(fep_t *fep, int16_t addr, uint8_t type, fep_handler_t handler, void *arg);
+
+/******************************************************************************
+Function: fep_tdmaStart()
+Purpose:  Make the module the coordinator of time slots (TDMA). fep_poll()
+          broadcasts a beacon at the start of every frame of slots *
+          slotMs ms, and the nodes (see fep_tdmaJoin()) send only in their
+          own slots, so that they don't collide in carrier sense. Sending
+          of the coordinator itself is held until its slot, too. Call
+          fep_poll() in the main loop of the coordinator.
+          A try is started only if it ends FEP_TDMA_GUARD_MS before the end
+          of the slot, so slotMs should be longer than a try of the longest
+          packet (see FEP_AIR_BPS) plus FEP_TDMA_GUARD_MS.
+Params:   fep - module
+          slots - slots in a frame (1 ~ 255)
+          slotMs - length of a slot [ms]
+          slot - own slot (0 ~ slots - 1)
+Return:   FEP_P0, or FEP_N0 if a parameter is wrong or FEP_tick() isn't
+          running
+******************************************************************************/
+uint8_t fep_tdmaStart(fep_t *fep, uint8_t slots, uint16_t slotMs, uint8_t slot);
+
+/******************************************************************************
+Function: fep_tdmaJoin()
+Purpose:  Send only in a slot of the frames of the coordinator. The frame
+          is taken from the beacons, which the rx handler consumes. Packets
+          wait FEP_TDMA_JOIN_MS at most for the first beacon, and are sent
+          at once without one, or after FEP_TDMA_MAX_MISSED beacons have
+          been missed.
+Params:   fep - module
+          slot - own slot, assigned by the application
+Return:   FEP_P0, or FEP_N0 if FEP_tick() isn't running
+******************************************************************************/
+uint8_t fep_tdmaJoin(fep_t *fep, uint8_t slot);
+
+/******************************************************************************
+Function: fep_tdmaStop()
+Purpose:  stop sending in slots (and beacons of the coordinator)
+Params:   fep - module
+Return:   none
+******************************************************************************/
+void fep_tdmaStop(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_gets()
+Function: FEP_tick()
+Purpose:  Advance the clock of the library. Call this function every 1 ms
+          from a timer interrupt. Until it is called, the clock advances only
+          while the library busy-waits for FEP, so the functions which
+          measure time between calls (the asynchronous API, the delay of
+          fep_batchPut(), TDMA) return FEP_N0, and FEP_IDLE_SLEEP
+          busy-waits instead of sleeping.
+Params:   none
+Return:   none
+******************************************************************************/
+void FEP_tick(void);
+
+/******************************************************************************
+Function: fep_gets()
 Purpose:  get string or binary data from transmitter.
-Params:   str - buffer for storing string
+Params:   fep - module
+          str - buffer for storing string
+          len - size of str
 Return:   If data is string, return constant FEP_DT_STR.
           If data is binary, return constant FEP_DT_BIN.
+          If nothing is received, or the data doesn't fit in str (len 0
+          for a string), return constant FEP_DT_ERR.
 ******************************************************************************/
-uint8_t FEP_gets(char *str, size_t len);
+uint8_t fep_gets(fep_t *fep, char *str, size_t len);
+
+/******************************************************************************
+Function: fep_recvFrame()
+Purpose:  get the oldest received frame without copying it.
+          Answers to fep_sendBulk() taken out of the queue are skipped.
+          The frame stays valid until fep_releaseFrame() is called.
+          Calling this function again before fep_releaseFrame() returns
+          the same frame.
+Params:   fep - module
+          out - variable for storing the pointer to the frame
+Return:   type of the frame (FEP_DT_STR, FEP_DT_BIN or FEP_DT_LINE).
+          If no frame has been received, return FEP_DT_ERR.
+******************************************************************************/
+uint8_t fep_recvFrame(fep_t *fep, const fep_frame_t **out);
 
 /******************************************************************************
-Function: FEP_getTransmitterAddr()
+Function: fep_releaseFrame()
+Purpose:  release the frame got by fep_recvFrame() and make its slot free
+Params:   fep - module
+Return:   none
+******************************************************************************/
+void fep_releaseFrame(fep_t *fep);
+
+/******************************************************************************
+Function: fep_getTransmitterAddr()
 Purpose:  get the address of transmitter. You can call this function
-          after you call FEP_gets().
-Params:   none
+          after you call fep_gets().
+Params:   fep - module
 Return:   Address of transmitter
 ******************************************************************************/
-uint8_t FEP_getTransmitterAddr(void);
+uint8_t fep_getTransmitterAddr(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_flushFEP()
+Function: fep_flushFEP()
 Purpose:  flush buffer of FEP
-Params:   none
+Params:   fep - module
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_flushFEP(void);
+uint8_t fep_flushFEP(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_getReg()
-Purpose:  get register value
-Params:   reg_num - register number
+Function: fep_getReg()
+Purpose:  get register value. The value is read from FEP only once and
+          then answered from the copy in the module.
+Params:   fep - module
+          reg_num - register number
 Return:   register value
 ******************************************************************************/
-uint8_t FEP_getReg(uint8_t reg_num);
+uint8_t fep_getReg(fep_t *fep, uint8_t reg_num);
 
 /******************************************************************************
-Function: FEP_setReg()
-Purpose:  set register value
-Params:   reg_num - register number
+Function: fep_setReg()
+Purpose:  set register value and reset FEP to activate it. Nothing is sent
+          if FEP already has the value. Between fep_beginConfig() and
+          fep_commitConfig(), the value is only stored to the module.
+Params:   fep - module
+          reg_num - register number
           val - value to set
-Return:   response from FEP
+Return:   response from FEP (FEP_P0 while the value is only stored,
+          FEP_N0 if reg_num is wrong)
 ******************************************************************************/
-uint8_t FEP_setReg(uint8_t reg_num, uint8_t val);
+uint8_t fep_setReg(fep_t *fep, uint8_t reg_num, uint8_t val);
 
 /******************************************************************************
-Function: FEP_getIntensity()
+Function: fep_getIntensity()
 Purpose:  get electric field intensity
-Params:   none
+Params:   fep - module
 Return:   intensity
 ******************************************************************************/
-int16_t FEP_getIntensity(void);
+int16_t fep_getIntensity(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_getMyAddr()
+Function: fep_getMyAddr()
 Purpose:  get own address of FEP
-Params:   none
+Params:   fep - module
 Return:   addres or response from FEP(If the instruction fails)
 ******************************************************************************/
-uint8_t FEP_getMyAddr(void);
+uint8_t fep_getMyAddr(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_setMyAddr()
+Function: fep_setMyAddr()
 Purpose:  set own address to FEP
-Params:   addr - address
+Params:   fep - module
+          addr - address
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_setMyAddr(uint8_t addr);
+uint8_t fep_setMyAddr(fep_t *fep, uint8_t addr);
 
 /******************************************************************************
-Function: FEP_getFrq()
-Purpose:  get frequency band setting
-Params:   ch1 - variable for storing channel1 value
+Function: fep_getFrq()
+Purpose:  get frequency band setting (cached like fep_getReg())
+Params:   fep - module
+          ch1 - variable for storing channel1 value
           ch2 - variable for storing channel2 value
           ch3 - variable for storing channel3 value
 Return:   none
 ******************************************************************************/
-void FEP_getFrq(uint8_t *ch1, uint8_t *ch2, uint8_t *ch3);
+void fep_getFrq(fep_t *fep, uint8_t *ch1, uint8_t *ch2, uint8_t *ch3);
 
 /******************************************************************************
-Function: FEP_setFrq()
-Purpose:  set frequency band
-Params:   ch1 - channel1 value
+Function: fep_setFrq()
+Purpose:  set frequency band. Only the changed channels are sent, and
+          nothing is sent between fep_beginConfig() and fep_commitConfig().
+Params:   fep - module
+          ch1 - channel1 value
           ch2 - channel2 value (In the single band mode, this value is ignored)
           ch3 - channel3 value (In the single or double band mode, this value is ignored)
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_setFrq(uint8_t ch1, uint8_t ch2, uint8_t ch3);
+uint8_t fep_setFrq(fep_t *fep, uint8_t ch1, uint8_t ch2, uint8_t ch3);
 
 /******************************************************************************
-Function: FEP_getID()
-Purpose:  get ID code
-Params:   none
+Function: fep_getID()
+Purpose:  get ID code (cached like fep_getReg())
+Params:   fep - module
 Return:   ID or response from FEP(If the instruction fails)
 ******************************************************************************/
-uint16_t FEP_getID(void);
+uint16_t fep_getID(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_setID()
-Purpose:  set ID code
-Params:   id - id value
+Function: fep_setID()
+Purpose:  set ID code. Nothing is sent if it isn't changed or between
+          fep_beginConfig() and fep_commitConfig().
+Params:   fep - module
+          id - id value
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_setID(uint16_t id);
+uint8_t fep_setID(fep_t *fep, uint16_t id);
+
+/******************************************************************************
+Function: fep_readConfig()
+Purpose:  Read all registers, bands and the ID from FEP at once. The queries
+          are sent back to back and the replies are matched in order, so
+          this takes about 80 ms at 38400 bps. After this, fep_getReg(),
+          fep_getFrq() and fep_getID() answer without communication.
+Params:   fep - module
+Return:   FEP_P0, or the response from FEP if a query failed
+          (FEP_NO_RESPONSE if FEP didn't reply)
+******************************************************************************/
+uint8_t fep_readConfig(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_reset()
+Function: fep_beginConfig()
+Purpose:  Start changing settings. fep_setReg(), fep_setMyAddr(),
+          fep_setFrq() and fep_setID() only store the values to the module
+          until fep_commitConfig() is called.
+Params:   fep - module
+Return:   none
+******************************************************************************/
+void fep_beginConfig(fep_t *fep);
+
+/******************************************************************************
+Function: fep_commitConfig()
+Purpose:  Write the settings changed after fep_beginConfig() to FEP, and
+          reset FEP once if a register has been changed. The settings which
+          could not be written are read from FEP again when they are needed.
+Params:   fep - module
+Return:   FEP_P0, or the first failed response from FEP
+******************************************************************************/
+uint8_t fep_commitConfig(fep_t *fep);
+
+/******************************************************************************
+Function: fep_reset()
 Purpose:  reset FEP.(Activate register setting.)
-Params:   none
+Params:   fep - module
 Return:   response from FEP
 ******************************************************************************/
-uint8_t FEP_reset(void);
+uint8_t fep_reset(fep_t *fep);
 
 /******************************************************************************
-Function: FEP_available()
-Purpose:  Determine if a line waiting in the receive buffer or not
-Params:   none
-Return:   When available: 1
+Function: fep_getBaud()
+Purpose:  get the bit rate between MCU and FEP
+Params:   fep - module
+Return:   bit rate [bps]
+******************************************************************************/
+uint32_t fep_getBaud(fep_t *fep);
+
+/******************************************************************************
+Function: fep_setBaud()
+Purpose:  Change the bit rate between MCU and FEP. The register of FEP is
+          written and FEP is reset, then the UART is switched and FEP is
+          asked whether it can be heard. If not, the UART goes back to the
+          old rate.
+Params:   fep - module
+          baud - bit rate [bps] (9600, 19200, 38400, 57600 or 115200)
+Return:   FEP_P0, FEP_N0 if the rate isn't supported or the UART can't make
+          it from F_CPU, or FEP_NO_RESPONSE if FEP isn't heard
+******************************************************************************/
+uint8_t fep_setBaud(fep_t *fep, uint32_t baud);
+
+/******************************************************************************
+Function: fep_detectBaud()
+Purpose:  Find the bit rate FEP is using by asking it at every rate, the
+          current one first. The UART is left at the rate found.
+Params:   fep - module
+Return:   bit rate [bps], or 0 if FEP doesn't answer (the UART is left at
+          the current rate)
+******************************************************************************/
+uint32_t fep_detectBaud(fep_t *fep);
+
+/******************************************************************************
+Function: fep_available()
+Purpose:  Determine if a frame waiting in the receive buffer or not
+Params:   fep - module
+Return:   number of frames waiting in the receive queue
           When unavailable: 0
 ******************************************************************************/
-uint16_t FEP_available(void);
+uint16_t fep_available(fep_t *fep);
+
+/******************************************************************************
+Function: fep_getRxOverflow()
+Purpose:  get the number of received frames dropped because the receive queue
+          was full
+Params:   fep - module
+Return:   number of dropped frames (saturates at 0xFFFF)
+******************************************************************************/
+uint16_t fep_getRxOverflow(fep_t *fep);
+
+/******************************************************************************
+Function: fep_getLink()
+Purpose:  Get the quality of the link to a peer. It is learned from the
+          packets received from the peer (fep_gets(), fep_recvFrame()) and
+          from the results of the packets sent to it.
+Params:   fep - module
+          addr - address of the peer
+          link - variable for storing the quality
+Return:   1 if the peer is in the table, otherwise 0
+******************************************************************************/
+uint8_t fep_getLink(fep_t *fep, uint8_t addr, fep_link_t *link);
+
+/******************************************************************************
+Function: fep_getLinks()
+Purpose:  get the quality of the links to all peers in the table
+Params:   fep - module
+          links - array for storing the qualities
+          max - number of elements of links
+Return:   number of peers stored
+******************************************************************************/
+uint8_t fep_getLinks(fep_t *fep, fep_link_t *links, uint8_t max);
+
+/******************************************************************************
+Function: fep_getStats()
+Purpose:  Get the counters of the module (see fep_stats_t). They are zero
+          unless the library is built with FEP_STATS.
+Params:   fep - module
+          stats - variable for storing the counters
+Return:   none
+******************************************************************************/
+void fep_getStats(fep_t *fep, fep_stats_t *stats);
 
 /******************************************************************************
-Function: FEP_rxHandler()
-Purpose:  Called in uart receive interrupt.
-Params:   data - newest data from uart
+Function: fep_resetStats()
+Purpose:  set the counters of the module to zero
+Params:   fep - module
+Return:   none
+******************************************************************************/
+void fep_resetStats(fep_t *fep);
+
+/******************************************************************************
+Function: fep_setSequence()
+Purpose:  Add a sequence number to every packet sent, so that the receivers
+          can drop the packets received twice (see fep_setPeerSequence()).
+          When FEP doesn't get ACK of a packet, the retry makes the receiver
+          get it again. The number takes FEP_SEQ_LEN byte of every packet,
+          so the data is up to FEP_MAX_PAYLOAD - FEP_SEQ_LEN bytes.
+Params:   fep - module
+          enable - 1: on, 0: off (default)
+Return:   none
+******************************************************************************/
+void fep_setSequence(fep_t *fep, uint8_t enable);
+
+/******************************************************************************
+Function: fep_setPeerSequence()
+Purpose:  Tell that the packets from a transmitter have sequence numbers
+          (it called fep_setSequence()). The number is removed from its
+          packets, and the packets received twice never reach fep_gets().
+          The packets of the other transmitters are passed as they are.
+Params:   fep - module
+          addr - transmitter's address, or FEP_ANY_ADDR for all
+          enable - 1: on, 0: off (default)
+Return:   FEP_P0, or FEP_N0 if addr is wrong
+******************************************************************************/
+uint8_t fep_setPeerSequence(fep_t *fep, int16_t addr, uint8_t enable);
+
+/******************************************************************************
+Function: fep_rxHandler()
+Purpose:  Called in uart receive interrupt. fep_init() registers it to the
+          transport. Decodes the line from FEP byte by byte. Packets are
+          stored to the receive queue, and responses (P0, N1, ...) and
+          replies to the query commands are passed to the waiting command.
+Params:   fep - module
+          data - newest data from uart
           error - error of uart
 Return:   none
 ******************************************************************************/
+void fep_rxHandler(fep_t *fep, uint8_t data, uint8_t error);
+
+/******************************************************************************
+Function: fep_stream()
+Purpose:  get the stream of the module for fprintf() and so on
+Params:   fep - module
+Return:   stream which writes to the module
+******************************************************************************/
+FILE *fep_stream(fep_t *fep);
+
+/*
+** Functions of the module initialized by FEP_init() (FEP_default).
+** They are the same as the fep_xxx() functions above.
+*/
+void FEP_init(uint8_t module, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id);
+void FEP_initTransport(const fep_transport_t *transport, uint8_t addr, uint8_t ch1, uint8_t ch2, uint8_t ch3, uint16_t id);
+uint8_t FEP_initProfile(const fep_transport_t *transport, const fep_profile_t *profile);
+uint8_t FEP_applyProfile(const fep_profile_t *profile);
+uint16_t FEP_getBootTime(void);
+#if !defined( FEP_NO_STR )
+uint8_t FEP_puts(char *str, uint8_t addr);
+uint8_t FEP_putsTimeout(char *str, uint8_t addr, uint16_t timeout);
+uint8_t FEP_putsVia(char *str, uint8_t addr, const fep_route_t *route);
+uint8_t FEP_putsAsync(const char *str, uint8_t addr, fep_callback_t cb, void *arg);
+uint8_t FEP_putsAsyncPrio(const char *str, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg);
+#endif
+#if !defined( FEP_NO_BIN )
+uint8_t FEP_putbin(char *ary, size_t len, uint8_t addr);
+uint8_t FEP_putbinTimeout(char *ary, size_t len, uint8_t addr, uint16_t timeout);
+uint8_t FEP_putbinVia(char *ary, size_t len, uint8_t addr, const fep_route_t *route);
+uint8_t FEP_sendBulk(const char *data, uint16_t len, uint8_t addr);
+uint8_t FEP_recvBulk(fep_bulk_t *bulk, uint16_t timeout);
+uint8_t FEP_batchPut(fep_batch_t *batch, const char *msg, uint8_t len, uint8_t addr);
+uint8_t FEP_batchFlush(fep_batch_t *batch);
+uint8_t FEP_batchPoll(fep_batch_t *batch);
+void FEP_pipeOpen(fep_pipe_t *pipe, uint8_t addr);
+uint8_t FEP_putbinAsync(const char *ary, size_t len, uint8_t addr, fep_callback_t cb, void *arg);
+uint8_t FEP_putbinAsyncPrio(const char *ary, size_t len, uint8_t addr, uint8_t prio, fep_callback_t cb, void *arg);
+#endif
+uint8_t FEP_setRoute(uint8_t addr, const fep_route_t *route);
+uint8_t FEP_getRoute(uint8_t addr, fep_route_t *route);
+uint8_t FEP_setTxQueue(uint8_t prio, uint8_t depth, uint16_t maxAge);
+void FEP_poll(void);
+uint8_t FEP_txPending(void);
+uint8_t FEP_onReceive(int16_t addr, uint8_t type, fep_handler_t handler, void *arg);
+uint8_t FEP_tdmaStart(uint8_t slots, uint16_t slotMs, uint8_t slot);
+uint8_t FEP_tdmaJoin(uint8_t slot);
+void FEP_tdmaStop(void);
+uint8_t FEP_gets(char *str, size_t len);
+uint8_t FEP_recvFrame(const fep_frame_t **out);
+void FEP_releaseFrame(void);
+uint8_t FEP_getTransmitterAddr(void);
+uint8_t FEP_flushFEP(void);
+uint8_t FEP_getReg(uint8_t reg_num);
+uint8_t FEP_setReg(uint8_t reg_num, uint8_t val);
+int16_t FEP_getIntensity(void);
+uint8_t FEP_getLink(uint8_t addr, fep_link_t *link);
+uint8_t FEP_getLinks(fep_link_t *links, uint8_t max);
+uint8_t FEP_getMyAddr(void);
+uint8_t FEP_setMyAddr(uint8_t addr);
+void FEP_getFrq(uint8_t *ch1, uint8_t *ch2, uint8_t *ch3);
+uint8_t FEP_setFrq(uint8_t ch1, uint8_t ch2, uint8_t ch3);
+uint16_t FEP_getID(void);
+uint8_t FEP_setID(uint16_t id);
+uint8_t FEP_reset(void);
+uint8_t FEP_readConfig(void);
+void FEP_beginConfig(void);
+uint8_t FEP_commitConfig(void);
+uint32_t FEP_getBaud(void);
+uint8_t FEP_setBaud(uint32_t baud);
+uint32_t FEP_detectBaud(void);
+uint16_t FEP_available(void);
+uint16_t FEP_getRxOverflow(void);
+void FEP_getStats(fep_stats_t *stats);
+void FEP_resetStats(void);
+void FEP_setSequence(uint8_t enable);
+uint8_t FEP_setPeerSequence(int16_t addr, uint8_t enable);
 void FEP_rxHandler(uint8_t data, uint8_t error);
 
 #endif /* _FEP_H */
@@ -0,0 +1,188 @@
+#ifndef _FEP_CONFIG_H
+#define _FEP_CONFIG_H
+
+/*
+ * Compile time configuration of the library. Every option has a default
+ * here; override it with -D on the command line, or put the overrides in a
+ * header of the application and compile with
+ * -DFEP_CONFIG_FILE='"my_fep_config.h"', which is included first.
+ */
+#if defined( FEP_CONFIG_FILE )
+#include FEP_CONFIG_FILE
+#endif
+
+/*
+** configuration
+*/
+/* Longest packet the library sends or receives, including the sequence
+ * number (see fep_setSequence()), up to FEP_MAX_DATA_LEN (256) which FEP
+ * can carry. Every frame of the receive queue and every fep_batch_t is sized
+ * by it, and longer packets from other modems are dropped as parse errors.
+ * The fragments of fep_sendBulk() are FEP_MAX_PAYLOAD - 6 bytes, so every
+ * modem of a bulk transfer must use the same value. */
+#ifndef FEP_MAX_PAYLOAD
+#define FEP_MAX_PAYLOAD 256
+#endif
+
+/* Number of received frames buffered between the rx handler and fep_gets()
+ * of every module. Must be a power of two. Each slot costs
+ * sizeof(fep_frame_t) (FEP_MAX_PAYLOAD + 13) bytes of SRAM. When the queue
+ * is full, the newest frame is dropped and counted (see
+ * fep_getRxOverflow()). */
+#ifndef FEP_RX_QUEUE_DEPTH
+#define FEP_RX_QUEUE_DEPTH 4
+#endif
+
+/* Define FEP_RX_DROP_OLDEST to drop the oldest frame instead when a packet
+ * arrives at the full receive queue, for applications which want the
+ * latest data (telemetry) rather than all of it. The frame between
+ * fep_recvFrame() and fep_releaseFrame() is never dropped; while the reader
+ * holds it, and for other lines from FEP, the newest frame is dropped. */
+/* #define FEP_RX_DROP_OLDEST */
+
+/* Number of packets of every module which can be queued by fep_putsAsync()
+ * and fep_putbinAsync() at each priority. Must be a power of two. */
+#ifndef FEP_TX_QUEUE_DEPTH
+#define FEP_TX_QUEUE_DEPTH 4
+#endif
+
+/* Number of priorities of the asynchronous send queue (see
+ * fep_putsAsyncPrio()). Each costs FEP_TX_QUEUE_DEPTH * 16 bytes of SRAM. */
+#ifndef FEP_TX_PRIORITIES
+#define FEP_TX_PRIORITIES 2
+#endif
+
+/* Bit rate on air and bytes added to every packet on air (preamble, header,
+ * CRC). Used to estimate how long a packet takes (see fep_putsTimeout()). */
+#ifndef FEP_AIR_BPS
+#define FEP_AIR_BPS 9600
+#endif
+#ifndef FEP_AIR_OVERHEAD
+#define FEP_AIR_OVERHEAD 24
+#endif
+
+/* Number of peers whose link quality and round trip time are remembered by
+ * a module (see fep_getLink()). When the table is full, the peer not heard
+ * from or sent to for the longest time is replaced. */
+#ifndef FEP_PEER_TABLE_SIZE
+#define FEP_PEER_TABLE_SIZE 8
+#endif
+
+/* Fastest bit rate between MCU and FEP that fep_init() switches to.
+ * fep_init() finds the rate FEP is using, and if a rate up to this one is
+ * close enough to what the UART can make from F_CPU (see
+ * FEP_BAUD_ERROR_PERMILLE), both sides are switched to it. The rates are
+ * 9600, 19200, 38400, 57600 and 115200 bps. */
+#ifndef FEP_BAUD_MAX
+#define FEP_BAUD_MAX 38400
+#endif
+
+/* Largest difference between a bit rate and the one made by the UART */
+#ifndef FEP_BAUD_ERROR_PERMILLE
+#define FEP_BAUD_ERROR_PERMILLE 20
+#endif
+
+/* Number of transmitters whose recent sequence numbers are remembered by
+ * a module (see fep_setPeerSequence()). When the table is full, the
+ * transmitter not heard from for the longest time is forgotten. The rx
+ * handler finds a transmitter at the entry of its address modulo the size
+ * at the end of a packet, and searches the whole table only when another
+ * transmitter has that entry, so keep it small. */
+#ifndef FEP_SEQ_TABLE_SIZE
+#define FEP_SEQ_TABLE_SIZE 8
+#endif
+
+/* Number of fragments fep_sendBulk() sends before the receiver answers
+ * which fragments have arrived. The receiver must be able to take them
+ * from the receive queue in the meantime. */
+#ifndef FEP_BULK_WINDOW
+#define FEP_BULK_WINDOW 16
+#endif
+
+/* Number of handlers of received frames a module can have (see
+ * fep_onReceive()). */
+#ifndef FEP_HANDLERS
+#define FEP_HANDLERS 4
+#endif
+
+/* Time at the end of a TDMA slot in which no try is started (see
+ * fep_tdmaStart()). Covers the ACK and the difference of the clocks. */
+#ifndef FEP_TDMA_GUARD_MS
+#define FEP_TDMA_GUARD_MS 10
+#endif
+
+/* Time a TDMA node waits for the first beacon after fep_tdmaJoin() before
+ * it sends without slots. Make it longer than a frame. */
+#ifndef FEP_TDMA_JOIN_MS
+#define FEP_TDMA_JOIN_MS 3000
+#endif
+
+/* Beacons a TDMA node may miss before it stops keeping to its slot and
+ * sends whenever it has data, as without TDMA */
+#ifndef FEP_TDMA_MAX_MISSED
+#define FEP_TDMA_MAX_MISSED 4
+#endif
+
+/* Define FEP_UART_MODULE as the number of the UART FEP is connected to
+ * when there is only one module. Only that UART's transport is compiled,
+ * and the library writes to it and the rx interrupt decodes with direct
+ * calls instead of through fep_transport_t. fep_init() and
+ * fep_initTransport() then take only that UART. Not used by the host
+ * build. */
+/* #define FEP_UART_MODULE 0 */
+
+/* Define FEP_UART_HAS_WRITE when avr-uart provides uartN_write(buf, len),
+ * which puts a block of bytes to the transmit ring buffer at once. Otherwise
+ * the uart transports write with uartN_putc() byte by byte. */
+/* #define FEP_UART_HAS_WRITE */
+
+/* Define FEP_IDLE_SLEEP to put the CPU into idle sleep while the library
+ * waits for FEP, instead of busy waiting with _delay_ms(). The CPU wakes at
+ * the next interrupt, e.g. a byte from FEP, and goes back to sleep if what
+ * it waits for hasn't come. Waits are timed by FEP_tick(), which must then
+ * be called every 1 ms by a timer interrupt. */
+/* #define FEP_IDLE_SLEEP */
+
+/* Define FEP_NO_STR to leave out the functions which send strings
+ * (fep_puts() and its variants), or FEP_NO_BIN to leave out the ones which
+ * send binary data (fep_putbin() and its variants, bulk transfer and
+ * batches). Packets of both kinds are still received. */
+/* #define FEP_NO_STR */
+/* #define FEP_NO_BIN */
+
+/* Define FEP_NO_QUERY to leave out reading the settings from FEP.
+ * fep_getReg() and the other getters then return only what the library has
+ * written (or 0), fep_readConfig() returns FEP_N0, and fep_applyProfile()
+ * writes the whole profile and resets FEP every time. */
+/* #define FEP_NO_QUERY */
+
+/* Define FEP_STATS to count what the driver does (see fep_getStats()).
+ * Without it the counters are compiled out and fep_getStats() returns
+ * zeros. The library and the application must be built with the same
+ * setting, because it changes fep_t. */
+/* #define FEP_STATS */
+
+/* Define FEP_STATS_CLOCK() as an expression reading a free-running 16-bit
+ * timer (e.g. TCNT1) to measure the longest run of the rx handler in its
+ * ticks. Used only with FEP_STATS. */
+/* #define FEP_STATS_CLOCK() TCNT1 */
+
+/* Number of bins of the intensity histogram of fep_getStats().
+ * Bin n counts the packets received with intensity
+ * n * 256 / FEP_STATS_INTENSITY_BINS and up. Must be a power of two. */
+#ifndef FEP_STATS_INTENSITY_BINS
+#define FEP_STATS_INTENSITY_BINS 8
+#endif
+
+/* Number of bins of the tries-per-packet histogram of fep_getStats().
+ * Bin n counts the packets finished at try n + 1; the last bin also counts
+ * the packets which took more tries. */
+#ifndef FEP_STATS_TRY_BINS
+#define FEP_STATS_TRY_BINS 4
+#endif
+
+#if defined( FEP_NO_STR ) && defined( FEP_NO_BIN )
+#error "FEP_NO_STR and FEP_NO_BIN leave nothing to send"
+#endif
+
+#endif /* _FEP_CONFIG_H */
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fep.h"
+#include "fep_host.h"
+
+/*
+ * Macros and constants
+ */
+#define FEP_HOST_MAX_TTY 4
+
+/*
+ * private types
+ */
+typedef struct {
+    int fd;
+    fep_transport_t transport;
+    fep_rxhandler_t handler;
+    void *arg;
+} fep_tty_t;
+
+/*
+ * private function prototypes
+ */
+/******************************************************************************
+Function: FEP_ttyInit()
+Purpose:  set the tty to raw mode with the bit rate (transport.init)
+Params:   ctx - fep_tty_t
+          baud - bit rate [bps]
+Return:   none
+******************************************************************************/
+static void FEP_ttyInit(void *ctx, uint32_t baud);
+
+/******************************************************************************
+Function: FEP_ttySetRxHandler()
+Purpose:  register rx handler (transport.setRxHandler)
+Params:   ctx - fep_tty_t
+          handler - function called for every received byte
+          arg - argument of handler
+Return:   none
+******************************************************************************/
+static void FEP_ttySetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg);
+
+/******************************************************************************
+Function: FEP_ttyWrite()
+Purpose:  send bytes (transport.write)
+Params:   ctx - fep_tty_t
+          buf - bytes to be sent
+          len - number of bytes
+Return:   none
+******************************************************************************/
+static void FEP_ttyWrite(void *ctx, const uint8_t *buf, uint16_t len);
+
+/******************************************************************************
+Function: FEP_ttyWait()
+Purpose:  wait on the real time, passing received bytes to the rx handlers
+Params:   us - time to wait [us]
+Return:   none
+******************************************************************************/
+static void FEP_ttyWait(uint32_t us);
+
+/******************************************************************************
+Function: FEP_hostNowUs()
+Purpose:  get monotonic time
+Params:   none
+Return:   time [us]
+******************************************************************************/
+static uint64_t FEP_hostNowUs(void);
+
+/*
+ *  Module global variables
+ */
+static void (*FEP_hostDelay)(uint32_t us);
+static void (*FEP_hostSleepFn)(void);
+static fep_tty_t FEP_tty[FEP_HOST_MAX_TTY];
+static uint8_t FEP_ttyCount;
+static uint64_t FEP_hostLastTick;
+
+/*
+ * functions
+ */
+void FEP_hostDelayUs(uint32_t us) {
+    if (FEP_hostDelay != NULL) {
+        (*FEP_hostDelay)(us);
+    } else {
+        FEP_ttyWait(us);
+    }
+}
+
+void FEP_hostSetDelay(void (*delay)(uint32_t us)) {
+    FEP_hostDelay = delay;
+}
+
+void FEP_hostSleep(void) {
+    if (FEP_hostSleepFn != NULL) {
+        (*FEP_hostSleepFn)();
+    } else {
+        /* the ttys are polled at least every 1 ms anyway */
+        FEP_hostDelayUs(1000);
+    }
+}
+
+void FEP_hostSetSleep(void (*sleep)(void)) {
+    FEP_hostSleepFn = sleep;
+}
+
+const fep_transport_t *FEP_hostOpenTty(const char *path) {
+    fep_tty_t *tty;
+    int fd;
+
+    if (FEP_ttyCount >= FEP_HOST_MAX_TTY) return NULL;
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) return NULL;
+
+    tty = &FEP_tty[FEP_ttyCount++];
+    tty->fd = fd;
+    tty->handler = NULL;
+    tty->arg = NULL;
+    tty->transport.init = FEP_ttyInit;
+    tty->transport.setRxHandler = FEP_ttySetRxHandler;
+    tty->transport.write = FEP_ttyWrite;
+    tty->transport.ctx = tty;
+
+    return &tty->transport;
+}
+
+static void FEP_ttyInit(void *ctx, uint32_t baud) {
+    fep_tty_t *tty = ctx;
+    struct termios tio;
+    speed_t speed;
+
+    switch (baud) {
+        case 9600: speed = B9600; break;
+        case 19200: speed = B19200; break;
+        case 38400: speed = B38400; break;
+        case 57600: speed = B57600; break;
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        default: speed = B38400; break;
+    }
+
+    if (tcgetattr(tty->fd, &tio) != 0) return; /* not a tty (e.g. fifo) */
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(tty->fd, TCSANOW, &tio);
+}
+
+static void FEP_ttySetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) {
+    fep_tty_t *tty = ctx;
+
+    tty->handler = handler;
+    tty->arg = arg;
+}
+
+static void FEP_ttyWrite(void *ctx, const uint8_t *buf, uint16_t len) {
+    fep_tty_t *tty = ctx;
+    struct pollfd pfd;
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(tty->fd, buf, len);
+        if (n > 0) {
+            buf += n;
+            len -= n;
+        } else {
+            /* transmit buffer of the device is full */
+            pfd.fd = tty->fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, 10);
+        }
+    }
+}
+
+static void FEP_ttyWait(uint32_t us) {
+    struct pollfd pfd[FEP_HOST_MAX_TTY];
+    uint64_t now, end;
+    uint8_t buf[64];
+    ssize_t n, i;
+    uint8_t j;
+    int timeout;
+
+    now = FEP_hostNowUs();
+    end = now + us;
+    if (FEP_hostLastTick == 0) FEP_hostLastTick = now;
+
+    do {
+        /* timer interrupt */
+        while (now - FEP_hostLastTick >= 1000) {
+            FEP_hostLastTick += 1000;
+            FEP_tick();
+        }
+
+        for (j = 0; j < FEP_ttyCount; j++) {
+            pfd[j].fd = FEP_tty[j].fd;
+            pfd[j].events = POLLIN;
+            pfd[j].revents = 0;
+        }
+        /* wake up at least every 1 ms for FEP_tick() */
+        timeout = (end - now >= 1000) ? 1 : 0;
+        poll(pfd, FEP_ttyCount, timeout);
+
+        /* receive interrupt */
+        for (j = 0; j < FEP_ttyCount; j++) {
+            if (!(pfd[j].revents & POLLIN)) continue;
+            while ((n = read(FEP_tty[j].fd, buf, sizeof(buf))) > 0) {
+                for (i = 0; i < n && FEP_tty[j].handler != NULL; i++) {
+                    (*FEP_tty[j].handler)(FEP_tty[j].arg, buf[i], 0);
+                }
+            }
+        }
+
+        now = FEP_hostNowUs();
+    } while (now < end);
+}
+
+static uint64_t FEP_hostNowUs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
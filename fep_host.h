@@ -0,0 +1,64 @@
+#ifndef _FEP_HOST_H
+#define _FEP_HOST_H
+
+/*
+ * Host (Linux) platform of avr-fep. Build everything with -DFEP_HOST.
+ * On the host, the rx handlers of the transports are called from
+ * FEP_hostDelayUs(), which replaces _delay_ms() and the timer interrupt,
+ * and from FEP_hostSleep(), which replaces the idle sleep of FEP_IDLE_SLEEP.
+ */
+
+#include <stdint.h>
+#include "fep.h"
+
+/*
+** function prototypes
+*/
+
+/******************************************************************************
+Function: FEP_hostDelayUs()
+Purpose:  Let the time pass. Received bytes are passed to the rx handlers
+          and FEP_tick() is called every 1 ms while waiting.
+          (_delay_ms() and _delay_us() of the library call this function)
+Params:   us - time to wait [us]
+Return:   none
+******************************************************************************/
+void FEP_hostDelayUs(uint32_t us);
+
+/******************************************************************************
+Function: FEP_hostSetDelay()
+Purpose:  Replace the implementation of FEP_hostDelayUs().
+          The simulator uses this to run on its own virtual time.
+Params:   delay - function which lets the time pass (NULL: real time)
+Return:   none
+******************************************************************************/
+void FEP_hostSetDelay(void (*delay)(uint32_t us));
+
+/******************************************************************************
+Function: FEP_hostSleep()
+Purpose:  Sleep until the next interrupt: a received byte or FEP_tick().
+          (the library calls this function with FEP_IDLE_SLEEP)
+Params:   none
+Return:   none
+******************************************************************************/
+void FEP_hostSleep(void);
+
+/******************************************************************************
+Function: FEP_hostSetSleep()
+Purpose:  Replace the implementation of FEP_hostSleep().
+          The simulator uses this to count the time the CPU sleeps.
+Params:   sleep - function which sleeps (NULL: FEP_hostDelayUs() for 1 ms)
+Return:   none
+******************************************************************************/
+void FEP_hostSetSleep(void (*sleep)(void));
+
+/******************************************************************************
+Function: FEP_hostOpenTty()
+Purpose:  Open a serial device or a pty as a transport.
+          The bit rate is set when FEP_initTransport() initializes it.
+Params:   path - path of the device (e.g. "/dev/ttyUSB0")
+Return:   transport, or NULL if the device can't be opened
+******************************************************************************/
+const fep_transport_t *FEP_hostOpenTty(const char *path);
+
+#endif /* _FEP_HOST_H */
@@ -0,0 +1,756 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fep.h"
+#include "fep_host.h"
+#include "fep_sim.h"
+
+/*
+ * Macros and constants
+ */
+#define FEP_SIM_LINE_LEN 1024   /* bytes in flight on a serial line (power of two) */
+#define FEP_SIM_CMD_LEN 300     /* longest command ("@TB2aaabbbccclll" + 256 + CRLF) + margin */
+#define FEP_SIM_REGS 32         /* number of registers */
+#define FEP_SIM_NS_PER_MS 1000000ULL
+#define FEP_SIM_BAUD_CODES 5    /* values of FEP_REG_BAUD */
+
+/* states of the transmitter of a modem */
+#define FEP_SIM_TX_IDLE 0       /* no packet */
+#define FEP_SIM_TX_CS   1       /* sensing the carrier */
+#define FEP_SIM_TX_AIR  2       /* sending the packet */
+#define FEP_SIM_TX_ACK  3       /* waiting ACK */
+
+/*
+ * private types
+ */
+/* serial line: bytes with the time they arrive */
+typedef struct {
+    uint64_t time[FEP_SIM_LINE_LEN];
+    uint8_t data[FEP_SIM_LINE_LEN];
+    uint16_t head;
+    uint16_t tail;
+    uint64_t free;              /* time the line becomes free */
+} fep_sim_line_t;
+
+typedef struct {
+    uint8_t addr;               /* active address */
+    uint8_t regs[FEP_SIM_REGS];
+    uint8_t band[3];
+    uint16_t id;
+    uint64_t deafUntil;         /* end of reset */
+
+    /* serial port */
+    uint32_t baud;              /* bit rate of the modem (FEP_REG_BAUD after @RST) */
+    uint32_t hostBaud;          /* bit rate the host has set its UART to */
+    fep_transport_t transport;
+    fep_rxhandler_t handler;
+    void *arg;
+    fep_sim_line_t toModem;
+    fep_sim_line_t toHost;
+
+    /* command parser */
+    uint8_t cmd[FEP_SIM_CMD_LEN + 1];
+    uint16_t cmdLen;
+    uint16_t binRemain;
+    uint8_t binStarted;
+
+    /* transmitter */
+    uint8_t txState;
+    uint64_t txTime;            /* time of the next event of the transmitter */
+    uint8_t txType;
+    uint8_t txDest;
+    uint8_t txHops;             /* repeaters on the way */
+    uint8_t txVia[FEP_MAX_REPEATERS];
+    uint16_t txLen;
+    uint8_t txData[FEP_MAX_DATA_LEN];
+    uint8_t csCount;
+    uint8_t result;
+    uint8_t collided;
+    uint8_t airData;            /* on air with a packet(1) or ACK(0) */
+    uint64_t airStart;
+    uint64_t airEnd;
+
+    fep_sim_stats_t stats;
+} fep_sim_node_t;
+
+/*
+ * private function prototypes
+ */
+static void FEP_simInitPort(void *ctx, uint32_t baud);
+static void FEP_simSetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg);
+static void FEP_simWrite(void *ctx, const uint8_t *buf, uint16_t len);
+
+/******************************************************************************
+Function: FEP_simLinePush()
+Purpose:  put a byte on a serial line
+Params:   line - serial line
+          time - time the byte is written
+          rate - bit rate of the writer [bps]
+          data - byte
+Return:   none
+******************************************************************************/
+static void FEP_simLinePush(fep_sim_line_t *line, uint64_t time, uint32_t rate, uint8_t data);
+
+/******************************************************************************
+Function: FEP_simEmit()
+Purpose:  send bytes from a modem to its host
+Params:   node - modem
+          time - time the bytes are written
+          buf - bytes
+          len - number of bytes
+Return:   none
+******************************************************************************/
+static void FEP_simEmit(fep_sim_node_t *node, uint64_t time, const void *buf, uint16_t len);
+
+/******************************************************************************
+Function: FEP_simRespond()
+Purpose:  send a response (P0, N1, ...) from a modem to its host
+Params:   node - modem
+          time - time of the response
+          response - FEP_P0, FEP_P1, FEP_N0, ...
+Return:   none
+******************************************************************************/
+static void FEP_simRespond(fep_sim_node_t *node, uint64_t time, uint8_t response);
+
+/******************************************************************************
+Function: FEP_simModemByte()
+Purpose:  a byte from host arrived at a modem
+Params:   node - modem
+          c - byte
+Return:   none
+******************************************************************************/
+static void FEP_simModemByte(fep_sim_node_t *node, uint8_t c);
+
+/******************************************************************************
+Function: FEP_simCommand()
+Purpose:  execute a command
+Params:   node - modem
+          len - length of the command in node->cmd without CRLF
+Return:   none
+******************************************************************************/
+static void FEP_simCommand(fep_sim_node_t *node, uint16_t len);
+
+/******************************************************************************
+Function: FEP_simTxEvent()
+Purpose:  progress the transmitter of a modem
+Params:   node - modem
+Return:   none
+******************************************************************************/
+static void FEP_simTxEvent(fep_sim_node_t *node);
+
+/******************************************************************************
+Function: FEP_simDeliver()
+Purpose:  decide the result of a packet at the end of its air time
+Params:   node - transmitter
+Return:   FEP_P0, FEP_N1 or FEP_N3
+******************************************************************************/
+static uint8_t FEP_simDeliver(fep_sim_node_t *node);
+
+/******************************************************************************
+Function: FEP_simReceive()
+Purpose:  pass a packet to the host of the receiver
+Params:   node - transmitter
+          dest - receiver
+          last - the node which sent the packet to the receiver (the last
+                 repeater, or node)
+Return:   none
+******************************************************************************/
+static void FEP_simReceive(fep_sim_node_t *node, fep_sim_node_t *dest, fep_sim_node_t *last);
+
+/******************************************************************************
+Function: FEP_simHeadLen()
+Purpose:  get the length of the header of a send command
+Params:   c - command ("@TXT", "@TBR", ...)
+Return:   length up to the data, or 0 if it isn't a send command
+******************************************************************************/
+static uint8_t FEP_simHeadLen(const uint8_t *c);
+
+static fep_sim_node_t *FEP_simFind(uint8_t addr);
+static uint8_t FEP_simChance(uint16_t permille);
+static uint32_t FEP_simRand(void);
+static uint16_t FEP_simDec(const uint8_t *p, uint8_t digits);
+
+/******************************************************************************
+Function: FEP_simAdvance()
+Purpose:  process the events up to a time
+Params:   end - time [ns]
+          wake - return after the first interrupt of the host MCU
+Return:   none
+******************************************************************************/
+static void FEP_simAdvance(uint64_t end, uint8_t wake);
+static uint64_t FEP_simAirNs(uint16_t bytes);
+
+/*
+ *  Module global variables
+ */
+static fep_sim_config_t FEP_simConfig;
+/* bit rates of the values of FEP_REG_BAUD */
+static const uint32_t FEP_simBaud[FEP_SIM_BAUD_CODES] = { 9600, 19200, 38400, 57600, 115200 };
+static fep_sim_node_t FEP_simNode[FEP_SIM_MAX_NODES];
+static uint8_t FEP_simNodes;
+static uint8_t FEP_simIntensity[FEP_SIM_MAX_NODES][FEP_SIM_MAX_NODES];
+static uint16_t FEP_simLoss[FEP_SIM_MAX_NODES][FEP_SIM_MAX_NODES];
+static uint64_t FEP_simNow;         /* [ns] */
+static uint64_t FEP_simNextTick;    /* [ns] */
+static uint32_t FEP_simSeed;
+static fep_sim_cpu_t FEP_simCpu;
+
+/*
+ * functions
+ */
+void FEP_simDefaultConfig(fep_sim_config_t *config) {
+    config->airRate = 9600;
+    config->serialRate = 38400;
+    config->airOverhead = 16;
+    config->ackLen = 8;
+    config->turnaroundUs = 1000;
+    config->resetUs = 60000;
+    config->csBackoffUs = 5000;
+    config->csRetry = 3;
+    config->intensity = 120;
+    config->lossPermille = 0;
+    config->ackLossPermille = 0;
+    config->fullPermille = 0;
+    config->seed = 1;
+    /* rough figures of an ATmega at 16 MHz and 5 V */
+    config->cpuActiveUa = 10000;
+    config->cpuSleepUa = 3000;
+    config->cpuWakeUs = 20;
+}
+
+void FEP_simInit(const fep_sim_config_t *config) {
+    if (config != NULL) {
+        FEP_simConfig = *config;
+    } else {
+        FEP_simDefaultConfig(&FEP_simConfig);
+    }
+
+    memset(FEP_simNode, 0, sizeof(FEP_simNode));
+    FEP_simNodes = 0;
+    FEP_simNow = 0;
+    FEP_simNextTick = FEP_SIM_NS_PER_MS;
+    FEP_simSeed = FEP_simConfig.seed ? FEP_simConfig.seed : 1;
+    memset(&FEP_simCpu, 0, sizeof(FEP_simCpu));
+
+    FEP_hostSetDelay(FEP_simRun);
+    FEP_hostSetSleep(FEP_simSleep);
+}
+
+int8_t FEP_simAddNode(uint8_t addr) {
+    fep_sim_node_t *node;
+    uint8_t i;
+
+    if (FEP_simNodes >= FEP_SIM_MAX_NODES) return -1;
+
+    node = &FEP_simNode[FEP_simNodes];
+    memset(node, 0, sizeof(*node));
+    node->addr = addr;
+    node->regs[0] = addr;
+    node->regs[13] = (1 << 7);  /* add intensity to received packets */
+    node->baud = FEP_simConfig.serialRate;
+    node->hostBaud = FEP_simConfig.serialRate;
+    for (i = 0; i < FEP_SIM_BAUD_CODES && FEP_simBaud[i] != node->baud; i++);
+    node->regs[FEP_REG_BAUD] = i;
+    /* the modem is powered on now and starts like after @RST */
+    node->deafUntil = FEP_simNow + (uint64_t)FEP_simConfig.resetUs * 1000;
+    node->band[0] = 1;
+    node->band[1] = 2;
+    node->band[2] = 3;
+    node->transport.init = FEP_simInitPort;
+    node->transport.setRxHandler = FEP_simSetRxHandler;
+    node->transport.write = FEP_simWrite;
+    node->transport.ctx = node;
+
+    for (i = 0; i <= FEP_simNodes; i++) {
+        FEP_simIntensity[i][FEP_simNodes] = FEP_simConfig.intensity;
+        FEP_simIntensity[FEP_simNodes][i] = FEP_simConfig.intensity;
+        FEP_simLoss[i][FEP_simNodes] = 0;
+        FEP_simLoss[FEP_simNodes][i] = 0;
+    }
+
+    return FEP_simNodes++;
+}
+
+const fep_transport_t *FEP_simTransport(uint8_t node) {
+    return &FEP_simNode[node].transport;
+}
+
+void FEP_simSetLink(uint8_t from, uint8_t to, uint8_t intensity, uint16_t lossPermille) {
+    FEP_simIntensity[from][to] = intensity;
+    FEP_simLoss[from][to] = lossPermille;
+}
+
+uint64_t FEP_simNowUs(void) {
+    return FEP_simNow / 1000;
+}
+
+void FEP_simGetStats(uint8_t node, fep_sim_stats_t *stats) {
+    *stats = FEP_simNode[node].stats;
+}
+
+void FEP_simGetCpu(fep_sim_cpu_t *cpu) {
+    *cpu = FEP_simCpu;
+    cpu->chargeUc = (FEP_simCpu.activeUs * FEP_simConfig.cpuActiveUa +
+                     FEP_simCpu.sleepUs * FEP_simConfig.cpuSleepUa) / 1000000;
+}
+
+void FEP_simRun(uint32_t us) {
+    FEP_simAdvance(FEP_simNow + (uint64_t)us * 1000, 0);
+    FEP_simCpu.activeUs += us;
+}
+
+void FEP_simSleep(void) {
+    uint64_t start = FEP_simNow;
+    uint64_t us;
+
+    /* FEP_tick() wakes the MCU up at the latest */
+    FEP_simAdvance(FEP_simNextTick, 1);
+    /* the interrupt and the code up to the next sleep run in this time */
+    us = (FEP_simNow - start) / 1000;
+    if (us > FEP_simConfig.cpuWakeUs) {
+        FEP_simCpu.sleepUs += us - FEP_simConfig.cpuWakeUs;
+        FEP_simCpu.activeUs += FEP_simConfig.cpuWakeUs;
+    } else {
+        FEP_simCpu.activeUs += us;
+    }
+    FEP_simCpu.wakeups++;
+}
+
+static void FEP_simAdvance(uint64_t end, uint8_t wake) {
+    uint64_t next;
+    fep_sim_node_t *node;
+    fep_sim_line_t *line;
+    uint8_t i, interrupted;
+
+    for (;;) {
+        /* find the next event */
+        next = FEP_simNextTick;
+        for (i = 0; i < FEP_simNodes; i++) {
+            node = &FEP_simNode[i];
+            if (node->toModem.head != node->toModem.tail &&
+                node->toModem.time[node->toModem.tail] < next)
+            {
+                next = node->toModem.time[node->toModem.tail];
+            }
+            if (node->toHost.head != node->toHost.tail &&
+                node->toHost.time[node->toHost.tail] < next)
+            {
+                next = node->toHost.time[node->toHost.tail];
+            }
+            if (node->txState != FEP_SIM_TX_IDLE && node->txTime < next) {
+                next = node->txTime;
+            }
+        }
+        if (next > end) break;
+        if (next > FEP_simNow) FEP_simNow = next;
+        interrupted = 0;
+
+        /* timer interrupt */
+        if (FEP_simNow >= FEP_simNextTick) {
+            FEP_simNextTick += FEP_SIM_NS_PER_MS;
+            FEP_tick();
+            interrupted = 1;
+        }
+
+        for (i = 0; i < FEP_simNodes; i++) {
+            node = &FEP_simNode[i];
+
+            /* host -> modem */
+            line = &node->toModem;
+            while (line->head != line->tail && line->time[line->tail] <= FEP_simNow) {
+                uint8_t c = line->data[line->tail];
+                line->tail = (line->tail + 1) & (FEP_SIM_LINE_LEN - 1);
+                /* framing error at a wrong rate: the modem ignores it */
+                if (node->hostBaud == node->baud) FEP_simModemByte(node, c);
+            }
+
+            /* modem -> host (receive interrupt) */
+            line = &node->toHost;
+            while (line->head != line->tail && line->time[line->tail] <= FEP_simNow) {
+                uint8_t c = line->data[line->tail];
+                line->tail = (line->tail + 1) & (FEP_SIM_LINE_LEN - 1);
+                if (node->handler != NULL) (*node->handler)(node->arg, c, node->hostBaud != node->baud);
+                interrupted = 1;
+            }
+
+            if (node->txState != FEP_SIM_TX_IDLE && node->txTime <= FEP_simNow) {
+                FEP_simTxEvent(node);
+            }
+        }
+        if (wake && interrupted) return;
+    }
+
+    FEP_simNow = end;
+}
+
+static void FEP_simInitPort(void *ctx, uint32_t baud) {
+    fep_sim_node_t *node = ctx;
+
+    node->hostBaud = baud;
+}
+
+static void FEP_simSetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) {
+    fep_sim_node_t *node = ctx;
+
+    node->handler = handler;
+    node->arg = arg;
+}
+
+static void FEP_simWrite(void *ctx, const uint8_t *buf, uint16_t len) {
+    fep_sim_node_t *node = ctx;
+
+    while (len--) {
+        FEP_simLinePush(&node->toModem, FEP_simNow, node->hostBaud, *buf++);
+    }
+}
+
+static void FEP_simLinePush(fep_sim_line_t *line, uint64_t time, uint32_t rate, uint8_t data) {
+    uint16_t next = (line->head + 1) & (FEP_SIM_LINE_LEN - 1);
+
+    if (next == line->tail) return; /* overrun */
+
+    if (line->free > time) time = line->free;
+    time += 10ULL * 1000000000ULL / rate; /* start + 8 data + stop bits */
+    line->free = time;
+
+    line->time[line->head] = time;
+    line->data[line->head] = data;
+    line->head = next;
+}
+
+static void FEP_simEmit(fep_sim_node_t *node, uint64_t time, const void *buf, uint16_t len) {
+    const uint8_t *p = buf;
+
+    while (len--) {
+        FEP_simLinePush(&node->toHost, time, node->baud, *p++);
+    }
+}
+
+static void FEP_simRespond(fep_sim_node_t *node, uint64_t time, uint8_t response) {
+    char buf[4];
+
+    switch (response) {
+        case FEP_P0: node->stats.p0++; memcpy(buf, "P0", 2); break;
+        case FEP_P1: memcpy(buf, "P1", 2); break;
+        case FEP_N0: node->stats.n0++; memcpy(buf, "N0", 2); break;
+        case FEP_N1: node->stats.n1++; memcpy(buf, "N1", 2); break;
+        case FEP_N2: memcpy(buf, "N2", 2); break;
+        default: node->stats.n3++; memcpy(buf, "N3", 2); break;
+    }
+    buf[2] = '\r';
+    buf[3] = '\n';
+    FEP_simEmit(node, time, buf, 4);
+}
+
+static void FEP_simModemByte(fep_sim_node_t *node, uint8_t c) {
+    if (FEP_simNow < node->deafUntil) return; /* resetting */
+
+    if (node->cmdLen >= FEP_SIM_CMD_LEN) {
+        /* too long */
+        node->cmdLen = 0;
+        node->binRemain = 0;
+        node->binStarted = 0;
+        FEP_simRespond(node, FEP_simNow, FEP_N0);
+    }
+    node->cmd[node->cmdLen++] = c;
+
+    if (node->binRemain > 0) {
+        /* binary data may contain CRLF */
+        node->binRemain--;
+        return;
+    }
+    if (!node->binStarted && node->cmdLen >= 10 && node->cmd[2] == 'B' &&
+        node->cmdLen == FEP_simHeadLen(node->cmd))
+    {
+        node->binRemain = FEP_simDec(node->cmd + node->cmdLen - 3, 3);
+        node->binStarted = 1;
+        return;
+    }
+    if (node->cmdLen >= 2 && node->cmd[node->cmdLen - 2] == '\r' && node->cmd[node->cmdLen - 1] == '\n') {
+        FEP_simCommand(node, node->cmdLen - 2);
+        node->cmdLen = 0;
+        node->binStarted = 0;
+    }
+}
+
+static void FEP_simCommand(fep_sim_node_t *node, uint16_t len) {
+    uint8_t *c = node->cmd;
+    uint8_t head;
+    char buf[8];
+    uint16_t n, i;
+
+    c[len] = '\0';
+    node->stats.commands++;
+    head = FEP_simHeadLen(c);
+
+    if (head > 0 && len >= head) {
+        /* @TXT/@TBN, through a repeater @TXR/@TBR, or two @TX2/@TB2 */
+        node->txHops = (c[3] == 'R') ? 1 : (c[3] == '2') ? 2 : 0;
+        n = (c[2] == 'X') ? len - head : FEP_simDec(c + head - 3, 3);
+        if (node->txState != FEP_SIM_TX_IDLE || n > FEP_MAX_DATA_LEN ||
+            (c[2] == 'B' && len != head + n))
+        {
+            FEP_simRespond(node, FEP_simNow, FEP_N0);
+            return;
+        }
+        node->txType = (c[2] == 'X') ? FEP_DT_STR : FEP_DT_BIN;
+        for (i = 0; i < node->txHops; i++) {
+            node->txVia[i] = FEP_simDec(c + 4 + 3 * i, 3);
+        }
+        node->txDest = FEP_simDec(c + 4 + 3 * node->txHops, 3);
+        if (node->txHops > 0 && node->txDest == FEP_SIM_BROADCAST) {
+            FEP_simRespond(node, FEP_simNow, FEP_N0);
+            return;
+        }
+        node->txLen = n;
+        memcpy(node->txData, c + head, n);
+        node->csCount = 0;
+        node->txState = FEP_SIM_TX_CS;
+        node->txTime = FEP_simNow;
+        FEP_simRespond(node, FEP_simNow, FEP_P1);
+    } else if (len == 6 && memcmp(c, "@REG", 4) == 0) {
+        n = FEP_simDec(c + 4, 2);
+        if (n >= FEP_SIM_REGS) {
+            FEP_simRespond(node, FEP_simNow, FEP_N0);
+            return;
+        }
+        snprintf(buf, sizeof(buf), "%02XH\r\n", node->regs[n]);
+        FEP_simEmit(node, FEP_simNow, buf, 5);
+    } else if (len == 10 && memcmp(c, "@REG", 4) == 0 && c[6] == ':') {
+        n = FEP_simDec(c + 4, 2);
+        if (n >= FEP_SIM_REGS) {
+            FEP_simRespond(node, FEP_simNow, FEP_N0);
+            return;
+        }
+        /* activated by @RST */
+        node->regs[n] = FEP_simDec(c + 7, 3);
+        FEP_simRespond(node, FEP_simNow, FEP_P0);
+    } else if (len == 5 && memcmp(c, "@FRQ", 4) == 0 && c[4] >= '1' && c[4] <= '3') {
+        snprintf(buf, sizeof(buf), "%02d\r\n", node->band[c[4] - '1']);
+        FEP_simEmit(node, FEP_simNow, buf, 4);
+    } else if (len == 8 && memcmp(c, "@FRQ", 4) == 0 && c[4] >= '1' && c[4] <= '3' && c[5] == ':') {
+        node->band[c[4] - '1'] = FEP_simDec(c + 6, 2);
+        FEP_simRespond(node, FEP_simNow, FEP_P0);
+    } else if (len == 4 && memcmp(c, "@IDR", 4) == 0) {
+        snprintf(buf, sizeof(buf), "%04XH\r\n", node->id);
+        FEP_simEmit(node, FEP_simNow, buf, 7);
+    } else if (len == 9 && memcmp(c, "@IDW", 4) == 0 && c[8] == 'H') {
+        for (n = 0, i = 4; i < 8; i++) {
+            if (c[i] == ' ') continue;
+            n = (n << 4) | ((c[i] <= '9') ? c[i] - '0' : (c[i] & ~0x20) - 'A' + 10);
+        }
+        node->id = n;
+        FEP_simRespond(node, FEP_simNow, FEP_P0);
+    } else if (len == 4 && memcmp(c, "@RST", 4) == 0) {
+        /* the modem is deaf until the reset finishes */
+        node->txState = FEP_SIM_TX_IDLE;
+        node->addr = node->regs[0];
+        if (node->regs[FEP_REG_BAUD] < FEP_SIM_BAUD_CODES) node->baud = FEP_simBaud[node->regs[FEP_REG_BAUD]];
+        node->deafUntil = FEP_simNow + (uint64_t)FEP_simConfig.resetUs * 1000;
+        FEP_simRespond(node, node->deafUntil, FEP_P0);
+    } else if (len == 4 && memcmp(c, "@BCL", 4) == 0) {
+        FEP_simRespond(node, FEP_simNow, FEP_P0);
+    } else {
+        FEP_simRespond(node, FEP_simNow, FEP_N0);
+    }
+}
+
+static void FEP_simTxEvent(fep_sim_node_t *node) {
+    fep_sim_node_t *other, *dest;
+    uint64_t blind = (uint64_t)FEP_simConfig.turnaroundUs * 1000;
+    uint8_t i, busy;
+
+    switch (node->txState) {
+        case FEP_SIM_TX_CS:
+            /* carrier sense: transmissions started within the blind time
+             * are not sensed and collide */
+            busy = 0;
+            for (i = 0; i < FEP_simNodes; i++) {
+                other = &FEP_simNode[i];
+                if (other == node || other->airEnd <= FEP_simNow) continue;
+                if (FEP_simLoss[i][node - FEP_simNode] >= 1000) continue; /* out of range */
+                if (FEP_simNow - other->airStart >= blind) busy = 1;
+            }
+            if (busy) {
+                if (++node->csCount > FEP_simConfig.csRetry) {
+                    node->txState = FEP_SIM_TX_IDLE;
+                    FEP_simRespond(node, FEP_simNow, FEP_N1);
+                } else {
+                    node->txTime = FEP_simNow + 1000 +
+                        (uint64_t)(FEP_simRand() % (FEP_simConfig.csBackoffUs + 1)) * 1000;
+                }
+                break;
+            }
+
+            node->collided = 0;
+            for (i = 0; i < FEP_simNodes; i++) {
+                other = &FEP_simNode[i];
+                if (other == node || other->airEnd <= FEP_simNow) continue;
+                node->collided = 1;
+                if (other->airData) {
+                    other->collided = 1;
+                    other->stats.collisions++;
+                }
+            }
+            if (node->collided) node->stats.collisions++;
+
+            /* every repeater sends the packet again after it */
+            node->airData = 1;
+            node->airStart = FEP_simNow;
+            node->airEnd = FEP_simNow + (node->txHops + 1) * FEP_simAirNs(node->txLen + FEP_simConfig.airOverhead);
+            node->stats.sent++;
+            node->stats.airUs += (node->airEnd - node->airStart) / 1000;
+            node->txState = FEP_SIM_TX_AIR;
+            node->txTime = node->airEnd;
+            break;
+
+        case FEP_SIM_TX_AIR:
+            node->result = FEP_simDeliver(node);
+            if (node->txDest == FEP_SIM_BROADCAST) {
+                node->txState = FEP_SIM_TX_IDLE;
+                FEP_simRespond(node, FEP_simNow, node->result);
+                break;
+            }
+
+            /* ACK comes back through the repeaters */
+            node->txState = FEP_SIM_TX_ACK;
+            node->txTime = FEP_simNow + (node->txHops + 1) * (blind + FEP_simAirNs(FEP_simConfig.ackLen));
+            dest = FEP_simFind(node->txDest);
+            if (node->result != FEP_N1 && dest != NULL && dest->airEnd <= FEP_simNow) {
+                /* the receiver sends ACK */
+                dest->airData = 0;
+                dest->airStart = FEP_simNow + blind;
+                dest->airEnd = node->txTime;
+            }
+            break;
+
+        default: /* FEP_SIM_TX_ACK */
+            node->txState = FEP_SIM_TX_IDLE;
+            FEP_simRespond(node, FEP_simNow, node->result);
+            break;
+    }
+}
+
+static uint8_t FEP_simDeliver(fep_sim_node_t *node) {
+    fep_sim_node_t *dest, *last;
+    uint8_t i, from = node - FEP_simNode;
+
+    if (node->txDest == FEP_SIM_BROADCAST) {
+        for (i = 0; i < FEP_simNodes; i++) {
+            dest = &FEP_simNode[i];
+            if (dest == node || node->collided || FEP_simNow < dest->deafUntil) continue;
+            if (FEP_simChance(FEP_simLoss[from][i]) || FEP_simChance(FEP_simConfig.lossPermille)) continue;
+            FEP_simReceive(node, dest, node);
+        }
+        return FEP_P0;
+    }
+
+    /* every hop must get through: to the repeaters, then the receiver */
+    if (node->collided) return FEP_N1;
+    last = node;
+    for (i = 0; i <= node->txHops; i++) {
+        dest = FEP_simFind((i < node->txHops) ? node->txVia[i] : node->txDest);
+        if (dest == NULL || dest == last || FEP_simNow < dest->deafUntil) return FEP_N1;
+        if (FEP_simChance(FEP_simLoss[from][dest - FEP_simNode]) ||
+            FEP_simChance(FEP_simConfig.lossPermille))
+        {
+            return FEP_N1;
+        }
+        if (i < node->txHops) {
+            last = dest;
+            from = dest - FEP_simNode;
+        }
+    }
+    if (FEP_simChance(FEP_simConfig.fullPermille)) return FEP_N3;
+
+    FEP_simReceive(node, dest, last);
+
+    if (FEP_simChance(FEP_simConfig.ackLossPermille)) return FEP_N1;
+    return FEP_P0;
+}
+
+static void FEP_simReceive(fep_sim_node_t *node, fep_sim_node_t *dest, fep_sim_node_t *last) {
+    char head[20];
+    uint8_t intensity = FEP_simIntensity[last - FEP_simNode][dest - FEP_simNode];
+    uint8_t n, i;
+
+    /* "RXTsss", "RXRsssrrr" or "RX2sssrrrrrr", where sss is the
+     * transmitter and rrr are the repeaters. "RBN"/"RBR"/"RB2" have the
+     * length after them */
+    head[0] = 'R';
+    head[1] = (node->txType == FEP_DT_STR) ? 'X' : 'B';
+    if (node->txHops == 0) {
+        head[2] = (node->txType == FEP_DT_STR) ? 'T' : 'N';
+    } else {
+        head[2] = (node->txHops == 1) ? 'R' : '2';
+    }
+    n = 3 + snprintf(head + 3, sizeof(head) - 3, "%03d", node->addr);
+    for (i = 0; i < node->txHops; i++) {
+        n += snprintf(head + n, sizeof(head) - n, "%03d", node->txVia[i]);
+    }
+    if (node->txType == FEP_DT_BIN) {
+        n += snprintf(head + n, sizeof(head) - n, "%03d", node->txLen);
+    }
+    FEP_simEmit(dest, FEP_simNow, head, n);
+    FEP_simEmit(dest, FEP_simNow, node->txData, node->txLen);
+    if (dest->regs[13] & (1 << 7)) {
+        snprintf(head, sizeof(head), "%03d", intensity);
+        FEP_simEmit(dest, FEP_simNow, head, 3);
+    }
+    FEP_simEmit(dest, FEP_simNow, "\r\n", 2);
+    dest->stats.received++;
+}
+
+static uint8_t FEP_simHeadLen(const uint8_t *c) {
+    uint8_t hops;
+
+    if (c[0] != '@' || c[1] != 'T' || (c[2] != 'X' && c[2] != 'B')) return 0;
+    if (c[3] == 'R') {
+        hops = 1;
+    } else if (c[3] == '2') {
+        hops = 2;
+    } else if (c[3] == ((c[2] == 'X') ? 'T' : 'N')) {
+        hops = 0;
+    } else {
+        return 0;
+    }
+
+    /* addresses of the repeaters and the receiver, and the length */
+    return 4 + 3 * (hops + 1) + ((c[2] == 'B') ? 3 : 0);
+}
+
+static fep_sim_node_t *FEP_simFind(uint8_t addr) {
+    uint8_t i;
+
+    for (i = 0; i < FEP_simNodes; i++) {
+        if (FEP_simNode[i].addr == addr) return &FEP_simNode[i];
+    }
+    return NULL;
+}
+
+static uint8_t FEP_simChance(uint16_t permille) {
+    if (permille == 0) return 0;
+    return (FEP_simRand() % 1000) < permille;
+}
+
+static uint32_t FEP_simRand(void) {
+    /* xorshift32 */
+    FEP_simSeed ^= FEP_simSeed << 13;
+    FEP_simSeed ^= FEP_simSeed >> 17;
+    FEP_simSeed ^= FEP_simSeed << 5;
+    return FEP_simSeed;
+}
+
+static uint16_t FEP_simDec(const uint8_t *p, uint8_t digits) {
+    uint16_t val = 0;
+
+    while (digits--) {
+        val = val * 10 + (*p++ - '0');
+    }
+    return val;
+}
+
+static uint64_t FEP_simAirNs(uint16_t bytes) {
+    return (uint64_t)bytes * 8 * 1000000000ULL / FEP_simConfig.airRate;
+}
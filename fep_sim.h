@@ -0,0 +1,165 @@
+#ifndef _FEP_SIM_H
+#define _FEP_SIM_H
+
+/*
+ * Software model of FEP-01/02 modems for the host build.
+ *
+ * Every node is a modem with its own serial port (see FEP_simTransport()).
+ * The modems understand @TXT, @TBN, @REG, @FRQ, @IDR, @IDW, @RST and @BCL,
+ * answer P0/P1/N0/N1/N3, and exchange packets on a shared air with carrier
+ * sense, air time, ACK and injected loss. Packets through repeaters (@TXR,
+ * @TBR, @TX2, @TB2) take the air time of every hop, must get through every
+ * link on the way, and are received as RXR/RBR/RX2/RB2 with the addresses
+ * of the repeaters after the transmitter's; the repeaters' own
+ * transmissions aren't carrier sensed by the others. The serial rate of a
+ * modem is FEP_REG_BAUD (0: 9600, 1: 19200, 2: 38400, 3: 57600, 4: 115200
+ * bps) from @RST on; while the host's UART is at another rate, the modem
+ * ignores the bytes from the host and the host gets framing errors.
+ *
+ * Time is virtual: it advances only in FEP_simRun(), which FEP_hostDelayUs()
+ * calls while the simulator is used, and in FEP_simSleep(), which
+ * FEP_hostSleep() calls. The time in FEP_simRun() counts as the host MCU
+ * running (busy waiting), and the time in FEP_simSleep() as the MCU
+ * sleeping (see FEP_simGetCpu()).
+ */
+
+#include <stdint.h>
+#include "fep.h"
+
+#define FEP_SIM_MAX_NODES 16
+#define FEP_SIM_BROADCAST 255   /* address received by all modems (no ACK) */
+
+/*
+ * types
+ */
+typedef struct {
+    uint32_t airRate;           /* bit rate on air [bps] */
+    uint32_t serialRate;        /* bit rate of modems after power on [bps] */
+    uint16_t airOverhead;       /* bytes added to every packet on air (preamble, header, CRC) */
+    uint16_t ackLen;            /* length of ACK on air [bytes] */
+    uint32_t turnaroundUs;      /* delay before ACK, and blind time of carrier sense */
+    uint32_t resetUs;           /* time a modem is deaf after @RST */
+    uint32_t csBackoffUs;       /* maximum random wait after the carrier is sensed */
+    uint8_t csRetry;            /* carrier sense retries before N1 */
+    uint8_t intensity;          /* default electric field intensity of links */
+    uint16_t lossPermille;      /* probability that a packet is lost on air */
+    uint16_t ackLossPermille;   /* probability that ACK is lost (receiver gets the packet, sender gets N1) */
+    uint16_t fullPermille;      /* probability that receiver's buffer is full (N3) */
+    uint32_t seed;              /* seed of random numbers */
+    uint32_t cpuActiveUa;       /* supply current of the host MCU while running [uA] */
+    uint32_t cpuSleepUa;        /* supply current of the host MCU in idle sleep [uA] */
+    uint32_t cpuWakeUs;         /* time the host MCU runs after every wakeup (interrupt) */
+} fep_sim_config_t;
+
+typedef struct {
+    uint32_t commands;          /* commands from host */
+    uint32_t sent;              /* packets sent on air */
+    uint32_t received;          /* packets passed to host */
+    uint32_t collisions;        /* sent packets broken by collision */
+    uint32_t p0;                /* responses */
+    uint32_t n0;
+    uint32_t n1;
+    uint32_t n3;
+    uint64_t airUs;             /* time this modem transmitted */
+} fep_sim_stats_t;
+
+typedef struct {
+    uint64_t activeUs;          /* time the host MCU ran (FEP_simRun()) */
+    uint64_t sleepUs;           /* time the host MCU slept (FEP_simSleep()) */
+    uint32_t wakeups;           /* times the host MCU went to sleep and woke up */
+    uint64_t chargeUc;          /* charge the host MCU used [uC] */
+} fep_sim_cpu_t;
+
+/*
+** function prototypes
+*/
+
+/******************************************************************************
+Function: FEP_simDefaultConfig()
+Purpose:  get the default configuration
+Params:   config - variable for storing the configuration
+Return:   none
+******************************************************************************/
+void FEP_simDefaultConfig(fep_sim_config_t *config);
+
+/******************************************************************************
+Function: FEP_simInit()
+Purpose:  Initializing the simulator. Removes all nodes, resets the virtual
+          time, and makes FEP_hostDelayUs() run the simulator.
+Params:   config - configuration (NULL: default)
+Return:   none
+******************************************************************************/
+void FEP_simInit(const fep_sim_config_t *config);
+
+/******************************************************************************
+Function: FEP_simAddNode()
+Purpose:  add a modem
+Params:   addr - address of the modem (register 0)
+Return:   node number, or -1 if there are FEP_SIM_MAX_NODES nodes
+******************************************************************************/
+int8_t FEP_simAddNode(uint8_t addr);
+
+/******************************************************************************
+Function: FEP_simTransport()
+Purpose:  get the serial port of a modem for FEP_initTransport()
+Params:   node - node number
+Return:   transport
+******************************************************************************/
+const fep_transport_t *FEP_simTransport(uint8_t node);
+
+/******************************************************************************
+Function: FEP_simSetLink()
+Purpose:  set the quality of the link from a node to another node
+Params:   from - node number of the transmitter
+          to - node number of the receiver
+          intensity - electric field intensity reported by the receiver
+          lossPermille - probability of losing a packet (1000: out of range,
+                         the carrier isn't sensed either)
+Return:   none
+******************************************************************************/
+void FEP_simSetLink(uint8_t from, uint8_t to, uint8_t intensity, uint16_t lossPermille);
+
+/******************************************************************************
+Function: FEP_simRun()
+Purpose:  advance the virtual time. Serial bytes, air transmissions and
+          FEP_tick() are processed in order.
+Params:   us - time [us]
+Return:   none
+******************************************************************************/
+void FEP_simRun(uint32_t us);
+
+/******************************************************************************
+Function: FEP_simSleep()
+Purpose:  advance the virtual time up to the next interrupt of the host MCU
+          (a received byte or FEP_tick())
+Params:   none
+Return:   none
+******************************************************************************/
+void FEP_simSleep(void);
+
+/******************************************************************************
+Function: FEP_simNowUs()
+Purpose:  get the virtual time
+Params:   none
+Return:   time since FEP_simInit() [us]
+******************************************************************************/
+uint64_t FEP_simNowUs(void);
+
+/******************************************************************************
+Function: FEP_simGetStats()
+Purpose:  get statistics of a modem
+Params:   node - node number
+          stats - variable for storing statistics
+Return:   none
+******************************************************************************/
+void FEP_simGetStats(uint8_t node, fep_sim_stats_t *stats);
+
+/******************************************************************************
+Function: FEP_simGetCpu()
+Purpose:  get the time the host MCU ran and slept since FEP_simInit()
+Params:   cpu - variable for storing the time and the charge
+Return:   none
+******************************************************************************/
+void FEP_simGetCpu(fep_sim_cpu_t *cpu);
+
+#endif /* _FEP_SIM_H */
@@ -0,0 +1,975 @@
+/*
+ * Tests of avr-fep on the host build, driven by the simulator.
+ *
+ * usage: fep_test
+ *
+ * Every case prints "ok <case>" or the failed checks, and the exit status
+ * is the number of failed checks (0: all passed).
+ *
+ *  "bulk"      fep_sendBulk() to a peer receiving with fep_bulkFeed(): all
+ *              data arrives through lost packets, lost ACKs and full
+ *              buffers, a lossless transfer sends every fragment once and
+ *              nothing else, and a missing receiver makes it give up.
+ *  "seq"       sequence numbers: packets received twice are dropped only
+ *              for the transmitters given to fep_setPeerSequence(), also
+ *              when the addresses of the transmitters collide, and retries
+ *              after lost ACKs reach the receiver once. TDMA beacons of a
+ *              coordinator sending numbers reach no application.
+ *  "baud"      fep_initProfile() finds modems at other bit rates, and
+ *              returns FEP_NO_RESPONSE when nothing answers.
+ *  "init"      fep_initTransport() writes only the settings given:
+ *              FEP_KEEP leaves the address, and the intensity bit keeps
+ *              the other bits of its register.
+ *  "handlers"  fep_poll() calls the most specific handler of
+ *              fep_onReceive(), and leaves frames without one for
+ *              fep_gets() while passing the frames behind them.
+ *  "config"    fep_setReg(), fep_commitConfig() and fep_readConfig() while
+ *              packets of fep_putbinAsync() are in flight: every packet is
+ *              sent once and succeeds, and the copy of the settings is
+ *              what FEP has.
+ *  "async"     fep_putbinAsync() finishes in fep_poll() and calls back
+ *              once, retries lost packets, reports N1 when nobody answers,
+ *              and returns N3 while the queue is full.
+ *  "prio"      an urgent packet goes right after the try in flight, ahead
+ *              of the queued ones, and packets older than the limit of
+ *              fep_setTxQueue() are dropped without being sent.
+ *  "query"     fep_readConfig() stores every reply to its own item while
+ *              several queries are in flight, and a late P0 of an earlier
+ *              command isn't taken as a reply.
+ *  "batch"     messages of fep_batchPut() arrive in order through
+ *              fep_batchNext(), one packet while they fit, and the delay
+ *              of fep_batchPoll() sends the rest.
+ *  "pipe"      fprintf()s to fep_pipeOut() go as one packet per line or
+ *              fep_pipeFlush(), and fep_pipeIn() reads them on the peer.
+ *  "tdma"      nodes sending back to back in the slots of a coordinator
+ *              don't collide, and send without it when its beacons stop.
+ *  "peers"     fep_getLink() counts every frame once however often it is
+ *              looked at, and a route learned from a relayed packet is
+ *              used when the direct link fails.
+ *  "rxqueue"   a full receive queue drops the newest frame, or with
+ *              FEP_RX_DROP_OLDEST ("rxqueue-oldest", make test builds
+ *              both) the oldest one which isn't being read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fep.h"
+#include "fep_host.h"
+#include "fep_sim.h"
+
+#define TEST_MY_ADDR 1
+#define TEST_PEER_ADDR 2
+#define TEST_BULK_LEN 4096
+#define TEST_ASYNC_N (FEP_TX_QUEUE_DEPTH + 1)   /* a queue full, and an urgent packet */
+
+#define TEST_CHECK(cond) test_check((cond), #cond, __LINE__)
+
+/*
+ * variables
+ */
+static fep_t test_me, test_peer;
+static void (*test_peerFn)(void);   /* runs the peer while the driver waits */
+static uint8_t test_busy;
+static uint16_t test_failures, test_caseFailures;
+
+static fep_bulk_t test_bulk;
+static char test_bulkBuf[TEST_BULK_LEN];
+static uint8_t test_bulkState;
+
+static char test_seqSeen[32];       /* times every packet has been received */
+
+static const char *test_handled;    /* arg of the last handler called */
+static uint8_t test_handledAddr;
+
+static char test_asyncData[TEST_ASYNC_N];
+static uint8_t test_asyncResult[TEST_ASYNC_N];
+static uint8_t test_asyncCalls[TEST_ASYNC_N];       /* times the callback has been called */
+static uint8_t test_asyncSeen[TEST_ASYNC_N];        /* times every packet has been received */
+static uint8_t test_asyncOrder[TEST_ASYNC_N];       /* packets in the order they finished */
+static uint8_t test_asyncDoneCount;
+
+static uint8_t test_lateP0;         /* FEP answers P0 once more */
+
+static char test_batchText[1024];   /* messages received, each followed by '|' */
+
+/*
+ * functions
+ */
+static void test_check(int ok, const char *expr, int line) {
+    if (ok) return;
+    printf("  FAIL line %d: %s\n", line, expr);
+    test_failures++;
+    test_caseFailures++;
+}
+
+static void test_end(const char *name) {
+    if (test_caseFailures == 0) printf("ok %s\n", name);
+    test_caseFailures = 0;
+}
+
+static void test_runPeer(void) {
+    if (test_peerFn == NULL || test_busy) return;
+    /* the peer's own waits come back here */
+    test_busy = 1;
+    (*test_peerFn)();
+    test_busy = 0;
+}
+
+static void test_delay(uint32_t us) {
+    FEP_simRun(us);
+    test_runPeer();
+}
+
+static void test_sleep(void) {
+    FEP_simSleep();
+    test_runPeer();
+}
+
+/* start the simulator with the driver (node 0) and nodes - 1 peers */
+static void test_simStart(const fep_sim_config_t *config, uint8_t nodes) {
+    uint8_t i;
+
+    test_peerFn = NULL;
+    FEP_simInit(config);
+    FEP_hostSetDelay(test_delay);
+    FEP_hostSetSleep(test_sleep);
+    for (i = 0; i < nodes; i++) {
+        FEP_simAddNode(TEST_MY_ADDR + i);
+    }
+    fep_initTransport(&test_me, FEP_simTransport(0), TEST_MY_ADDR, 1, 2, 3, 0);
+    if (nodes > 1) {
+        fep_initTransport(&test_peer, FEP_simTransport(1), TEST_PEER_ADDR, 1, 2, 3, 0);
+    }
+}
+
+static void test_fill(char *buf, uint16_t len) {
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (char)(i * 7 + (i >> 8));
+    }
+}
+
+/* bulk */
+static void test_bulkPeer(void) {
+    const fep_frame_t *frame;
+    uint8_t state;
+
+    while (fep_recvFrame(&test_peer, &frame) != FEP_DT_ERR) {
+        state = fep_bulkFeed(&test_peer, &test_bulk, frame);
+        if (state != FEP_BULK_NONE) test_bulkState = state;
+        fep_releaseFrame(&test_peer);
+    }
+}
+
+static uint8_t test_bulkSend(uint16_t lossPermille, uint16_t ackLossPermille, uint16_t fullPermille, uint32_t seed) {
+    static char data[TEST_BULK_LEN];
+    fep_sim_config_t config;
+    uint8_t response;
+
+    FEP_simDefaultConfig(&config);
+    config.lossPermille = lossPermille;
+    config.ackLossPermille = ackLossPermille;
+    config.fullPermille = fullPermille;
+    config.seed = seed;
+    test_simStart(&config, 2);
+
+    test_fill(data, sizeof(data));
+    memset(test_bulkBuf, 0, sizeof(test_bulkBuf));
+    fep_bulkInit(&test_bulk, test_bulkBuf, sizeof(test_bulkBuf));
+    test_bulkState = FEP_BULK_NONE;
+    test_peerFn = test_bulkPeer;
+
+    response = fep_sendBulk(&test_me, data, sizeof(data), TEST_PEER_ADDR);
+    if (response == FEP_P0) {
+        TEST_CHECK(test_bulkState == FEP_BULK_DONE);
+        TEST_CHECK(test_bulk.len == sizeof(data));
+        TEST_CHECK(memcmp(test_bulkBuf, data, sizeof(data)) == 0);
+    }
+    return response;
+}
+
+static void test_bulkCase(void) {
+    static char data[TEST_BULK_LEN];
+    fep_sim_stats_t stats;
+    uint64_t start;
+    uint32_t seed;
+
+    /* every fragment once, and no other packet */
+    TEST_CHECK(test_bulkSend(0, 0, 0, 1) == FEP_P0);
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent == (TEST_BULK_LEN + FEP_BULK_FRAG_LEN - 1) / FEP_BULK_FRAG_LEN);
+
+    for (seed = 1; seed <= 10; seed++) {
+        TEST_CHECK(test_bulkSend(200, 0, 0, seed) == FEP_P0);
+        TEST_CHECK(test_bulkSend(100, 100, 100, seed) == FEP_P0);
+    }
+
+    /* nobody at the address */
+    test_simStart(NULL, 1);
+    test_fill(data, sizeof(data));
+    start = FEP_simNowUs();
+    TEST_CHECK(fep_sendBulk(&test_me, data, sizeof(data), TEST_PEER_ADDR) != FEP_P0);
+    TEST_CHECK(FEP_simNowUs() - start < 60000000);
+
+    TEST_CHECK(fep_sendBulk(&test_me, data, 0, TEST_PEER_ADDR) == FEP_N0);
+    TEST_CHECK(fep_sendBulk(&test_me, data, FEP_BULK_MAX_LEN + 1, TEST_PEER_ADDR) == FEP_N0);
+
+    test_end("bulk");
+}
+
+/* seq */
+static void test_seqFeed(const char *line) {
+    while (*line != '\0') {
+        fep_rxHandler(&test_me, (uint8_t)*line++, 0);
+    }
+}
+
+static uint8_t test_seqGets(char *buf, size_t len) {
+    buf[0] = '\0';
+    return fep_gets(&test_me, buf, len);
+}
+
+static void test_seqPeer(void) {
+    char buf[FEP_MAX_DATA_LEN + 1];
+    int n;
+
+    while (fep_gets(&test_peer, buf, sizeof(buf)) != FEP_DT_ERR) {
+        n = atoi(buf);
+        if (n >= 0 && n < (int)sizeof(test_seqSeen)) test_seqSeen[n]++;
+    }
+}
+
+static void test_seqCase(void) {
+    fep_sim_config_t config;
+    fep_sim_stats_t stats;
+    char buf[FEP_MAX_DATA_LEN + 1];
+    uint8_t i, n, sent[sizeof(test_seqSeen)];
+
+    test_simStart(NULL, 1);
+
+    /* a transmitter which isn't opted in keeps its last character */
+    test_seqFeed("RXT001abc1123\r\n");
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "abc1") == 0);
+
+    /* copies are dropped and the number is removed */
+    TEST_CHECK(fep_setPeerSequence(&test_me, 1, 1) == FEP_P0);
+    test_seqFeed("RXT001a1123\r\n");
+    test_seqFeed("RXT001a1123\r\n");
+    test_seqFeed("RXT001b2123\r\n");
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "a") == 0);
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "b") == 0);
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_ERR);
+
+    /* as many transmitters as the table, whose addresses would share a
+     * slot of a table indexed by the address: all of them are kept */
+    TEST_CHECK(fep_setPeerSequence(&test_me, FEP_ANY_ADDR, 1) == FEP_P0);
+    for (i = 0; i < FEP_SEQ_TABLE_SIZE; i++) {
+        sprintf(buf, "RXT%03ux1123\r\n", 10 + i * FEP_SEQ_TABLE_SIZE);
+        test_seqFeed(buf);
+        TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+    }
+    test_seqFeed("RXT010x1123\r\n");
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_ERR);
+
+    TEST_CHECK(fep_setPeerSequence(&test_me, 256, 1) == FEP_N0);
+    TEST_CHECK(fep_setPeerSequence(&test_me, -2, 1) == FEP_N0);
+
+    /* retries after lost ACKs */
+    FEP_simDefaultConfig(&config);
+    config.ackLossPermille = 300;
+    test_simStart(&config, 2);
+    fep_setSequence(&test_me, 1);
+    fep_setPeerSequence(&test_peer, TEST_MY_ADDR, 1);
+    memset(test_seqSeen, 0, sizeof(test_seqSeen));
+    test_peerFn = test_seqPeer;
+    for (i = 0; i < sizeof(test_seqSeen); i++) {
+        sprintf(buf, "%u", i);
+        sent[i] = (fep_puts(&test_me, buf, TEST_PEER_ADDR) == FEP_P0);
+    }
+    FEP_hostDelayUs(100000);
+    /* the peer's modem has passed copies */
+    FEP_simGetStats(1, &stats);
+    for (i = 0, n = 0; i < sizeof(test_seqSeen); i++) n += test_seqSeen[i];
+    TEST_CHECK(stats.received > n);
+    for (i = 0; i < sizeof(test_seqSeen); i++) {
+        TEST_CHECK(test_seqSeen[i] <= 1);
+        if (sent[i]) TEST_CHECK(test_seqSeen[i] == 1);
+    }
+
+    /* the beacons have no number, whether the node expects one or not */
+    for (i = 0; i < 2; i++) {
+        test_simStart(NULL, 2);
+        fep_setSequence(&test_me, 1);
+        fep_setPeerSequence(&test_peer, TEST_MY_ADDR, i);
+        TEST_CHECK(fep_tdmaStart(&test_me, 2, 100, 0) == FEP_P0);
+        TEST_CHECK(fep_tdmaJoin(&test_peer, 1) == FEP_P0);
+        for (n = 0; n < 50; n++) {
+            fep_poll(&test_me);
+            FEP_hostDelayUs(10000);
+        }
+        TEST_CHECK(test_peer.tdma.slots == 2);
+        TEST_CHECK(fep_gets(&test_peer, buf, sizeof(buf)) == FEP_DT_ERR);
+    }
+
+    test_end("seq");
+}
+
+/* baud */
+static void test_deadInit(void *ctx, uint32_t baud) {
+}
+
+static void test_deadSetRxHandler(void *ctx, fep_rxhandler_t handler, void *arg) {
+}
+
+static void test_deadWrite(void *ctx, const uint8_t *buf, uint16_t len) {
+}
+
+static const fep_transport_t test_dead = {
+    test_deadInit, test_deadSetRxHandler, test_deadWrite, NULL
+};
+
+static void test_baudCase(void) {
+    static const uint32_t rates[] = { 9600, 38400, 115200 };
+    fep_sim_config_t config;
+    fep_profile_t profile;
+    uint8_t i;
+
+    fep_profileInit(&profile, TEST_MY_ADDR, 1, 2, 3, 0);
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        FEP_simDefaultConfig(&config);
+        config.serialRate = rates[i];
+        FEP_simInit(&config);
+        FEP_hostSetDelay(test_delay);
+        FEP_hostSetSleep(test_sleep);
+        test_peerFn = NULL;
+        FEP_simAddNode(TEST_MY_ADDR);
+        FEP_simAddNode(TEST_PEER_ADDR);
+
+        TEST_CHECK(fep_initProfile(&test_me, FEP_simTransport(0), &profile) == FEP_P0);
+        /* and a slow one is raised */
+        TEST_CHECK(fep_getBaud(&test_me) >= rates[i]);
+        TEST_CHECK(fep_getMyAddr(&test_me) == TEST_MY_ADDR);
+        fep_initTransport(&test_peer, FEP_simTransport(1), TEST_PEER_ADDR, 1, 2, 3, 0);
+        TEST_CHECK(fep_puts(&test_me, "hello", TEST_PEER_ADDR) == FEP_P0);
+    }
+
+    TEST_CHECK(fep_initProfile(&test_me, &test_dead, &profile) == FEP_NO_RESPONSE);
+
+    test_end("baud");
+}
+
+/* init */
+static void test_initCase(void) {
+    fep_sim_stats_t stats;
+    uint32_t commands;
+
+    test_simStart(NULL, 1);
+    fep_initTransport(&test_me, FEP_simTransport(0), FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP_ID);
+
+    /* nothing to write: no reset */
+    FEP_simGetStats(0, &stats);
+    commands = stats.commands;
+    fep_initTransport(&test_me, FEP_simTransport(0), FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP_ID);
+    FEP_simGetStats(0, &stats);
+    /* the ping (an empty line and @REG00) and @REG13 */
+    TEST_CHECK(stats.commands - commands == 3);
+
+    fep_initTransport(&test_me, FEP_simTransport(0), 7, FEP_KEEP, 9, FEP_KEEP, FEP_KEEP_ID);
+    TEST_CHECK(fep_getMyAddr(&test_me) == 7);
+    fep_initTransport(&test_me, FEP_simTransport(0), FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP_ID);
+    TEST_CHECK(fep_getMyAddr(&test_me) == 7);
+
+    TEST_CHECK(fep_setReg(&test_me, FEP_REG_INTENSITY, 0x05) == FEP_P0);
+    fep_initTransport(&test_me, FEP_simTransport(0), FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP_ID);
+    TEST_CHECK(fep_getReg(&test_me, FEP_REG_INTENSITY) == 0x85);
+
+    test_end("init");
+}
+
+/* handlers */
+static void test_handler(const fep_frame_t *frame, void *arg) {
+    test_handled = arg;
+    test_handledAddr = frame->addr;
+}
+
+static const char *test_handlersSend(fep_t *from, uint8_t binary) {
+    test_handled = NULL;
+    if (binary) {
+        fep_putbin(from, "b", 1, TEST_MY_ADDR);
+    } else {
+        fep_puts(from, "s", TEST_MY_ADDR);
+    }
+    FEP_hostDelayUs(50000);
+    fep_poll(&test_me);
+    return test_handled;
+}
+
+static void test_handlersCase(void) {
+    static fep_t third;
+    char buf[16];
+    const char *handled;
+    uint8_t i;
+
+    test_simStart(NULL, 3);
+    fep_initTransport(&third, FEP_simTransport(2), TEST_MY_ADDR + 2, 1, 2, 3, 0);
+
+    TEST_CHECK(fep_onReceive(&test_me, TEST_PEER_ADDR, FEP_DT_STR, test_handler, "peer-str") == FEP_P0);
+    TEST_CHECK(fep_onReceive(&test_me, FEP_ANY_ADDR, FEP_DT_BIN, test_handler, "any-bin") == FEP_P0);
+    TEST_CHECK(fep_onReceive(&test_me, TEST_MY_ADDR + 2, FEP_DT_ANY, test_handler, "third-any") == FEP_P0);
+
+    /* address and type, then address before type */
+    TEST_CHECK((handled = test_handlersSend(&test_peer, 0)) != NULL && strcmp(handled, "peer-str") == 0);
+    TEST_CHECK((handled = test_handlersSend(&test_peer, 1)) != NULL && strcmp(handled, "any-bin") == 0);
+    TEST_CHECK((handled = test_handlersSend(&third, 1)) != NULL && strcmp(handled, "third-any") == 0);
+    TEST_CHECK(test_handledAddr == TEST_MY_ADDR + 2);
+    TEST_CHECK((handled = test_handlersSend(&third, 0)) != NULL && strcmp(handled, "third-any") == 0);
+
+    /* without a handler, the frame is left for fep_gets() */
+    TEST_CHECK(fep_onReceive(&test_me, TEST_MY_ADDR + 2, FEP_DT_ANY, NULL, NULL) == FEP_P0);
+    TEST_CHECK(test_handlersSend(&third, 0) == NULL);
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "s") == 0);
+
+    /* and the frames behind it are still passed */
+    fep_puts(&third, "t", TEST_MY_ADDR);
+    TEST_CHECK((handled = test_handlersSend(&test_peer, 0)) != NULL && strcmp(handled, "peer-str") == 0);
+    TEST_CHECK((handled = test_handlersSend(&test_peer, 1)) != NULL && strcmp(handled, "any-bin") == 0);
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "t") == 0);
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_ERR);
+
+    /* the wildcards aren't an address or a type */
+    TEST_CHECK(fep_onReceive(&test_me, 256, FEP_DT_STR, test_handler, NULL) == FEP_N0);
+    TEST_CHECK(fep_onReceive(&test_me, -2, FEP_DT_STR, test_handler, NULL) == FEP_N0);
+    TEST_CHECK(fep_onReceive(&test_me, 1, FEP_DT_ERR, test_handler, NULL) == FEP_N0);
+    TEST_CHECK(fep_onReceive(&test_me, 1, FEP_DT_ANY + 1, test_handler, NULL) == FEP_N0);
+
+    /* the table is full */
+    for (i = 0; i < FEP_HANDLERS - 2; i++) {
+        TEST_CHECK(fep_onReceive(&test_me, 100 + i, FEP_DT_ANY, test_handler, NULL) == FEP_P0);
+    }
+    TEST_CHECK(fep_onReceive(&test_me, 200, FEP_DT_ANY, test_handler, NULL) == FEP_N3);
+
+    test_end("handlers");
+}
+
+/* config */
+static void test_asyncDone(uint8_t response, void *arg) {
+    uint8_t n = (char *)arg - test_asyncData;
+
+    test_asyncResult[n] = response;
+    test_asyncCalls[n]++;
+    if (test_asyncDoneCount < TEST_ASYNC_N) test_asyncOrder[test_asyncDoneCount] = n;
+    test_asyncDoneCount++;
+}
+
+static void test_asyncReset(void) {
+    uint8_t i;
+
+    for (i = 0; i < TEST_ASYNC_N; i++) {
+        test_asyncData[i] = i;
+        test_asyncResult[i] = FEP_NO_RESPONSE;
+        test_asyncCalls[i] = 0;
+        test_asyncSeen[i] = 0;
+    }
+    test_asyncDoneCount = 0;
+}
+
+static void test_asyncPeer(void) {
+    const fep_frame_t *frame;
+    uint8_t n;
+
+    while (fep_recvFrame(&test_peer, &frame) != FEP_DT_ERR) {
+        n = (uint8_t)frame->data[0];
+        if (frame->type == FEP_DT_BIN && frame->len == 1 && n < TEST_ASYNC_N) test_asyncSeen[n]++;
+        fep_releaseFrame(&test_peer);
+    }
+}
+
+/* queue a packet of every slot of FEP_PRIO_NORMAL, and let the first try
+ * start */
+static void test_asyncQueue(uint8_t start) {
+    uint8_t i;
+
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        test_asyncResult[i] = FEP_NO_RESPONSE;
+        TEST_CHECK(fep_putbinAsync(&test_me, &test_asyncData[i], 1, TEST_PEER_ADDR, test_asyncDone, &test_asyncData[i]) == FEP_P1);
+    }
+    if (start) fep_poll(&test_me);
+}
+
+/* run fep_poll() until n callbacks have been called */
+static void test_asyncWait(uint8_t n) {
+    uint16_t ms;
+
+    for (ms = 0; ms < 30000 && test_asyncDoneCount < n; ms++) {
+        fep_poll(&test_me);
+        FEP_hostDelayUs(1000);
+    }
+    TEST_CHECK(test_asyncDoneCount == n);
+}
+
+static void test_asyncFinish(void) {
+    uint8_t i;
+
+    test_asyncWait(FEP_TX_QUEUE_DEPTH);
+    test_asyncDoneCount = 0;
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_asyncResult[i] == FEP_P0);
+    }
+}
+
+static void test_configCase(void) {
+    fep_sim_stats_t stats;
+    uint32_t sent;
+    uint8_t intensity, i;
+
+    test_simStart(NULL, 2);
+    test_peerFn = test_asyncPeer;
+    test_asyncReset();
+    intensity = fep_getReg(&test_me, FEP_REG_INTENSITY);
+    FEP_simGetStats(0, &stats);
+    sent = stats.sent;
+
+    test_asyncQueue(1);
+    TEST_CHECK(fep_setReg(&test_me, FEP_REG_INTENSITY, intensity ^ 0x80) == FEP_P0);
+    test_asyncFinish();
+
+    test_asyncQueue(1);
+    fep_beginConfig(&test_me);
+    TEST_CHECK(fep_setReg(&test_me, FEP_REG_INTENSITY, intensity) == FEP_P0);
+    TEST_CHECK(fep_setID(&test_me, 0x1234) == FEP_P0);
+    TEST_CHECK(fep_commitConfig(&test_me) == FEP_P0);
+    test_asyncFinish();
+
+    test_asyncQueue(1);
+    TEST_CHECK(fep_readConfig(&test_me) == FEP_P0);
+    TEST_CHECK(fep_getReg(&test_me, FEP_REG_INTENSITY) == intensity);
+    TEST_CHECK(fep_getID(&test_me) == 0x1234);
+    TEST_CHECK(fep_getMyAddr(&test_me) == TEST_MY_ADDR);
+    test_asyncFinish();
+
+    /* no packet is sent again after its response is taken by a command */
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent - sent == 3 * FEP_TX_QUEUE_DEPTH);
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_asyncSeen[i] == 3);
+    }
+
+    test_end("config");
+}
+
+/* async */
+static void test_asyncCase(void) {
+    fep_sim_config_t config;
+    fep_sim_stats_t simStats;
+    fep_stats_t stats;
+    uint8_t i;
+
+    /* finished by fep_poll(), while the queue is full */
+    test_simStart(NULL, 2);
+    test_peerFn = test_asyncPeer;
+    test_asyncReset();
+    test_asyncQueue(0);
+    TEST_CHECK(fep_putbinAsync(&test_me, "x", 1, TEST_PEER_ADDR, NULL, NULL) == FEP_N3);
+    test_asyncFinish();
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_asyncCalls[i] == 1);
+        TEST_CHECK(test_asyncSeen[i] == 1);
+    }
+
+    /* lost packets are tried again, and only the delivered ones are P0 */
+    FEP_simDefaultConfig(&config);
+    config.lossPermille = 300;
+    config.seed = 3;
+    test_simStart(&config, 2);
+    test_peerFn = test_asyncPeer;
+    test_asyncReset();
+    fep_resetStats(&test_me);
+    test_asyncQueue(1);
+    test_asyncWait(FEP_TX_QUEUE_DEPTH);
+    fep_getStats(&test_me, &stats);
+    TEST_CHECK(stats.retries > 0);
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_asyncCalls[i] == 1);
+        TEST_CHECK((test_asyncResult[i] == FEP_P0) == (test_asyncSeen[i] == 1));
+    }
+
+    /* nobody at the address */
+    test_simStart(NULL, 1);
+    test_asyncReset();
+    TEST_CHECK(fep_putbinAsync(&test_me, &test_asyncData[0], 1, TEST_PEER_ADDR, test_asyncDone, &test_asyncData[0]) == FEP_P1);
+    test_asyncWait(1);
+    TEST_CHECK(test_asyncResult[0] == FEP_N1);
+    TEST_CHECK(test_asyncCalls[0] == 1);
+    FEP_simGetStats(0, &simStats);
+    TEST_CHECK(simStats.sent > 1);
+
+    test_end("async");
+}
+
+/* prio */
+static void test_prioCase(void) {
+    fep_sim_stats_t stats;
+    uint32_t sent;
+    uint8_t urgent = FEP_TX_QUEUE_DEPTH, i;
+
+    test_simStart(NULL, 2);
+    test_peerFn = test_asyncPeer;
+    test_asyncReset();
+    test_asyncQueue(1);
+    TEST_CHECK(fep_putbinAsyncPrio(&test_me, &test_asyncData[urgent], 1, TEST_PEER_ADDR, FEP_PRIO_URGENT, test_asyncDone, &test_asyncData[urgent]) == FEP_P1);
+    test_asyncWait(TEST_ASYNC_N);
+    TEST_CHECK(test_asyncOrder[0] == 0);
+    TEST_CHECK(test_asyncOrder[1] == urgent);
+    for (i = 0; i < TEST_ASYNC_N; i++) {
+        TEST_CHECK(test_asyncResult[i] == FEP_P0);
+    }
+
+    /* stale before fep_poll() comes */
+    TEST_CHECK(fep_setTxQueue(&test_me, FEP_PRIO_NORMAL, FEP_TX_QUEUE_DEPTH, 50) == FEP_P0);
+    test_asyncReset();
+    FEP_simGetStats(0, &stats);
+    sent = stats.sent;
+    test_asyncQueue(0);
+    FEP_hostDelayUs(100000);
+    fep_poll(&test_me);
+    for (i = 0; i < FEP_TX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_asyncResult[i] == FEP_DROPPED);
+        TEST_CHECK(test_asyncCalls[i] == 1);
+    }
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent == sent);
+
+    TEST_CHECK(fep_setTxQueue(&test_me, FEP_TX_PRIORITIES, 1, 0) == FEP_N0);
+    TEST_CHECK(fep_setTxQueue(&test_me, FEP_PRIO_NORMAL, FEP_TX_QUEUE_DEPTH + 1, 0) == FEP_N0);
+
+    test_end("prio");
+}
+
+/* query */
+static void test_lateP0Peer(void) {
+    if (!test_lateP0) return;
+    test_lateP0 = 0;
+    test_seqFeed("P0\r\n");
+}
+
+static void test_queryCase(void) {
+    uint8_t ch1, ch2, ch3;
+
+    test_simStart(NULL, 1);
+    TEST_CHECK(fep_setFrq(&test_me, 4, 5, 6) == FEP_P0);
+    TEST_CHECK(fep_setID(&test_me, 0x0ABC) == FEP_P0);
+    TEST_CHECK(fep_setReg(&test_me, 20, 77) == FEP_P0);
+
+    /* a new module knows nothing of them */
+    fep_initTransport(&test_me, FEP_simTransport(0), FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP, FEP_KEEP_ID);
+    test_lateP0 = 1;
+    test_peerFn = test_lateP0Peer;
+    TEST_CHECK(fep_readConfig(&test_me) == FEP_P0);
+    TEST_CHECK(test_lateP0 == 0);
+    test_peerFn = NULL;
+
+    fep_getFrq(&test_me, &ch1, &ch2, &ch3);
+    TEST_CHECK(ch1 == 4 && ch2 == 5 && ch3 == 6);
+    TEST_CHECK(fep_getID(&test_me) == 0x0ABC);
+    TEST_CHECK(fep_getReg(&test_me, 20) == 77);
+    TEST_CHECK(fep_getMyAddr(&test_me) == TEST_MY_ADDR);
+
+    test_end("query");
+}
+
+/* batch */
+static void test_batchPeer(void) {
+    const fep_frame_t *frame;
+    const char *msg;
+    uint16_t pos;
+    uint8_t len;
+    size_t n;
+
+    while (fep_recvFrame(&test_peer, &frame) != FEP_DT_ERR) {
+        pos = 0;
+        while (fep_batchNext(frame, &pos, &msg, &len)) {
+            n = strlen(test_batchText);
+            if (n + len + 1 < sizeof(test_batchText)) {
+                memcpy(test_batchText + n, msg, len);
+                strcpy(test_batchText + n + len, "|");
+            }
+        }
+        fep_releaseFrame(&test_peer);
+    }
+}
+
+static void test_batchCase(void) {
+    fep_sim_stats_t stats;
+    fep_batch_t batch;
+    char msg[24], expect[sizeof(test_batchText)];
+    uint32_t sent;
+    uint8_t i, n;
+
+    test_simStart(NULL, 2);
+    test_peerFn = test_batchPeer;
+    test_batchText[0] = '\0';
+    FEP_simGetStats(0, &stats);
+    sent = stats.sent;
+
+    fep_batchInit(&batch, 0);
+    TEST_CHECK(fep_batchPut(&test_me, &batch, "m0", 2, TEST_PEER_ADDR) == FEP_P1);
+    TEST_CHECK(fep_batchPut(&test_me, &batch, "m1", 2, TEST_PEER_ADDR) == FEP_P1);
+    TEST_CHECK(fep_batchPut(&test_me, &batch, "", 0, TEST_PEER_ADDR) == FEP_P1);
+    TEST_CHECK(fep_batchFlush(&test_me, &batch) == FEP_P0);
+    FEP_hostDelayUs(20000);
+    TEST_CHECK(strcmp(test_batchText, "m0|m1||") == 0);
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent - sent == 1);
+
+    /* one message more than a packet takes */
+    test_batchText[0] = '\0';
+    expect[0] = '\0';
+    sent = stats.sent;
+    n = FEP_MAX_PAYLOAD / 21 + 1;
+    for (i = 0; i < n; i++) {
+        sprintf(msg, "%02u..................", i);
+        TEST_CHECK(fep_batchPut(&test_me, &batch, msg, 20, TEST_PEER_ADDR) == FEP_P1);
+        strcat(expect, msg);
+        strcat(expect, "|");
+    }
+    TEST_CHECK(fep_batchFlush(&test_me, &batch) == FEP_P0);
+    FEP_hostDelayUs(100000);
+    TEST_CHECK(strcmp(test_batchText, expect) == 0);
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent - sent == 2);
+
+    /* the delay */
+    test_batchText[0] = '\0';
+    fep_batchInit(&batch, 20);
+    TEST_CHECK(fep_batchPut(&test_me, &batch, "late", 4, TEST_PEER_ADDR) == FEP_P1);
+    TEST_CHECK(fep_batchPoll(&test_me, &batch) == FEP_P1);
+    FEP_hostDelayUs(30000);
+    TEST_CHECK(fep_batchPoll(&test_me, &batch) == FEP_P0);
+    FEP_hostDelayUs(20000);
+    TEST_CHECK(strcmp(test_batchText, "late|") == 0);
+
+    TEST_CHECK(fep_batchPut(&test_me, &batch, expect, 255, TEST_PEER_ADDR) == FEP_N0);
+
+    test_end("batch");
+}
+
+/* pipe */
+static void test_pipeCase(void) {
+    static fep_pipe_t out, in;
+    fep_sim_stats_t stats;
+    char buf[32];
+    uint32_t sent;
+
+    test_simStart(NULL, 2);
+    fep_pipeOpen(&test_me, &out, TEST_PEER_ADDR);
+    fep_pipeOpen(&test_peer, &in, TEST_MY_ADDR);
+    FEP_simGetStats(0, &stats);
+    sent = stats.sent;
+
+    fprintf(fep_pipeOut(&out), "x=%d ", 1);
+    fprintf(fep_pipeOut(&out), "y=%d\n", 2);
+    FEP_hostDelayUs(20000);
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent - sent == 1);
+    TEST_CHECK(fgets(buf, sizeof(buf), fep_pipeIn(&in)) != NULL && strcmp(buf, "x=1 y=2\n") == 0);
+    TEST_CHECK(fgetc(fep_pipeIn(&in)) == EOF);
+
+    fprintf(fep_pipeOut(&out), "z");
+    TEST_CHECK(fep_pipeFlush(&out) == FEP_P0);
+    TEST_CHECK(fep_pipeFlush(&out) == FEP_P0);
+    FEP_hostDelayUs(20000);
+    clearerr(fep_pipeIn(&in));
+    TEST_CHECK(fgetc(fep_pipeIn(&in)) == 'z');
+    FEP_simGetStats(0, &stats);
+    TEST_CHECK(stats.sent - sent == 2);
+
+    test_end("pipe");
+}
+
+/* tdma */
+static void test_tdmaDone(uint8_t response, void *arg) {
+    if (response == FEP_P0) (*(uint32_t *)arg)++;
+}
+
+/* nodes[0] receives, and the others keep their queues full */
+static void test_tdmaRun(fep_t *nodes, uint8_t count, uint16_t ms, uint32_t *delivered) {
+    static char data[32];
+    char buf[FEP_MAX_DATA_LEN + 1];
+    uint8_t i;
+
+    for (; ms > 0; ms--) {
+        for (i = 1; i < count; i++) {
+            while (fep_putbinAsync(&nodes[i], data, sizeof(data), TEST_MY_ADDR,
+                                   test_tdmaDone, &delivered[i]) == FEP_P1);
+            fep_poll(&nodes[i]);
+        }
+        fep_poll(&nodes[0]);
+        while (fep_gets(&nodes[0], buf, sizeof(buf)) != FEP_DT_ERR);
+        FEP_hostDelayUs(1000);
+    }
+}
+
+static void test_tdmaCase(void) {
+    static fep_t nodes[4];
+    fep_sim_stats_t stats;
+    uint32_t delivered[4] = { 0 }, before[4];
+    uint8_t i;
+
+    FEP_simInit(NULL);
+    FEP_hostSetDelay(test_delay);
+    FEP_hostSetSleep(test_sleep);
+    test_peerFn = NULL;
+    for (i = 0; i < 4; i++) {
+        FEP_simAddNode(TEST_MY_ADDR + i);
+    }
+    for (i = 0; i < 4; i++) {
+        fep_initTransport(&nodes[i], FEP_simTransport(i), TEST_MY_ADDR + i, 1, 2, 3, 0);
+    }
+    /* the coordinator's own slot is 0 */
+    TEST_CHECK(fep_tdmaStart(&nodes[0], 4, 100, 0) == FEP_P0);
+    for (i = 1; i < 4; i++) {
+        TEST_CHECK(fep_tdmaJoin(&nodes[i], i) == FEP_P0);
+    }
+
+    test_tdmaRun(nodes, 4, 4000, delivered);
+    for (i = 1; i < 4; i++) {
+        TEST_CHECK(nodes[i].tdma.slots == 4);
+        TEST_CHECK(delivered[i] > 0);
+        FEP_simGetStats(i, &stats);
+        TEST_CHECK(stats.collisions == 0);
+        TEST_CHECK(stats.n1 == 0);
+        before[i] = delivered[i];
+    }
+
+    /* the coordinator has gone */
+    fep_tdmaStop(&nodes[0]);
+    test_tdmaRun(nodes, 4, 4000, delivered);
+    for (i = 1; i < 4; i++) {
+        TEST_CHECK(delivered[i] > before[i]);
+    }
+
+    TEST_CHECK(fep_tdmaStart(&nodes[0], 4, 100, 4) == FEP_N0);
+    TEST_CHECK(fep_tdmaStart(&nodes[0], 0, 100, 0) == FEP_N0);
+
+    test_end("tdma");
+}
+
+/* peers */
+static void test_peersCase(void) {
+    fep_route_t route, learned;
+    fep_link_t link;
+    char buf[16];
+    uint8_t i;
+
+    test_simStart(NULL, 3);
+
+    /* the first frame sets the intensity, and every next one adds 1/8 of
+     * the difference once */
+    FEP_simSetLink(1, 0, 80, 0);
+    fep_puts(&test_peer, "a", TEST_MY_ADDR);
+    FEP_hostDelayUs(20000);
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_STR);
+    FEP_simSetLink(1, 0, 160, 0);
+    fep_puts(&test_peer, "b", TEST_MY_ADDR);
+    FEP_hostDelayUs(20000);
+    for (i = 0; i < 3; i++) {
+        fep_poll(&test_me);
+    }
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(fep_getLink(&test_me, TEST_PEER_ADDR, &link) == 1);
+    TEST_CHECK(link.intensity == 90);
+    TEST_CHECK(fep_getLink(&test_me, TEST_MY_ADDR + 2, &link) == 0);
+
+    /* a relayed packet teaches the route, which isn't used yet */
+    route.hops = 1;
+    route.via[0] = TEST_MY_ADDR + 2;
+    strcpy(buf, "c");
+    TEST_CHECK(fep_putsVia(&test_peer, buf, TEST_MY_ADDR, &route) == FEP_P0);
+    FEP_hostDelayUs(20000);
+    TEST_CHECK(fep_gets(&test_me, buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(fep_getRoute(&test_me, TEST_PEER_ADDR, &learned) == 1);
+    TEST_CHECK(learned.hops == 0);
+
+    /* the direct link breaks: the packet goes through the repeater */
+    FEP_simSetLink(0, 1, 100, 1000);
+    TEST_CHECK(fep_puts(&test_me, "d", TEST_PEER_ADDR) == FEP_P0);
+    TEST_CHECK(fep_getRoute(&test_me, TEST_PEER_ADDR, &learned) == 1);
+    TEST_CHECK(learned.hops == 1 && learned.via[0] == TEST_MY_ADDR + 2);
+    FEP_hostDelayUs(20000);
+    TEST_CHECK(fep_gets(&test_peer, buf, sizeof(buf)) == FEP_DT_STR);
+    TEST_CHECK(strcmp(buf, "d") == 0);
+
+    test_end("peers");
+}
+
+/* rxqueue */
+static void test_rxqueueCase(void) {
+    const fep_frame_t *frame;
+    char buf[16];
+    uint8_t i, first;
+
+    test_simStart(NULL, 1);
+    for (i = 0; i < FEP_RX_QUEUE_DEPTH + 2; i++) {
+        sprintf(buf, "RXT002%u123\r\n", i);
+        test_seqFeed(buf);
+    }
+    TEST_CHECK(fep_getRxOverflow(&test_me) == 2);
+#if defined( FEP_RX_DROP_OLDEST )
+    first = 2;
+#else
+    first = 0;
+#endif
+    for (i = 0; i < FEP_RX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+        TEST_CHECK(atoi(buf) == first + i);
+    }
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_ERR);
+
+    /* the frame being read stays */
+    for (i = 0; i < FEP_RX_QUEUE_DEPTH; i++) {
+        sprintf(buf, "RXT002%u123\r\n", i);
+        test_seqFeed(buf);
+    }
+    TEST_CHECK(fep_recvFrame(&test_me, &frame) == FEP_DT_STR);
+    test_seqFeed("RXT0029123\r\n");
+    TEST_CHECK(frame->data[0] == '0');
+    fep_releaseFrame(&test_me);
+    for (i = 1; i < FEP_RX_QUEUE_DEPTH; i++) {
+        TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_STR);
+        TEST_CHECK(atoi(buf) == i);
+    }
+    TEST_CHECK(test_seqGets(buf, sizeof(buf)) == FEP_DT_ERR);
+
+#if defined( FEP_RX_DROP_OLDEST )
+    test_end("rxqueue-oldest");
+#else
+    test_end("rxqueue");
+#endif
+}
+
+int main(void) {
+    test_bulkCase();
+    test_seqCase();
+    test_baudCase();
+    test_initCase();
+    test_handlersCase();
+    test_configCase();
+    test_asyncCase();
+    test_prioCase();
+    test_queryCase();
+    test_batchCase();
+    test_pipeCase();
+    test_tdmaCase();
+    test_peersCase();
+    test_rxqueueCase();
+
+    return (test_failures > 255) ? 255 : test_failures;
+}